@@ -0,0 +1,110 @@
+#include "Benchmark.h"
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <thread>
+
+double BenchmarkStage::Median() const
+{
+  if (seconds.empty())
+    return 0;
+  std::vector<double> sorted(seconds);
+  std::sort(sorted.begin(), sorted.end());
+  size_t n = sorted.size();
+  return n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+}
+
+double BenchmarkStage::Min() const
+{
+  return seconds.empty() ? 0 : *std::min_element(seconds.begin(), seconds.end());
+}
+
+double BenchmarkStage::Mean() const
+{
+  double sum = 0;
+  for (size_t i = 0; i < seconds.size(); i++)
+    sum += seconds[i];
+  return seconds.empty() ? 0 : sum / seconds.size();
+}
+
+BenchmarkStage &BenchmarkCase::Stage(const std::string &name)
+{
+  for (size_t i = 0; i < stages.size(); i++)
+  {
+    if (stages[i].name == name)
+      return stages[i];
+  }
+  stages.push_back(BenchmarkStage());
+  stages.back().name = name;
+  return stages.back();
+}
+
+bool BenchmarkReport::Write(const std::string &path) const
+{
+  FILE *file = fopen(path.c_str(), "w");
+  if (file == nullptr)
+  {
+    printf("Could not write benchmark results %s\n", path.c_str());
+    return false;
+  }
+  char date[32];
+  time_t now = time(NULL);
+  strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+#ifdef __OPTIMIZE__
+  const char *optimized = "true";
+#else
+  const char *optimized = "false";
+#endif
+#ifdef __VERSION__
+  const char *compiler = __VERSION__;
+#else
+  const char *compiler = "unknown";
+#endif
+
+  fprintf(file, "{\n  \"version\": 1,\n  \"date\": \"%s\",\n  \"compiler\": \"%s\",\n  \"optimized\": %s,\n", date, compiler, optimized);
+  fprintf(file, "  \"isa\": \"%s\",\n  \"cores\": %u,\n  \"seed\": %llu,\n  \"cases\": [", isa.c_str(),
+          std::thread::hardware_concurrency(), static_cast<unsigned long long>(seed));
+  for (size_t k = 0; k < cases.size(); k++)
+  {
+    const BenchmarkCase &c = cases[k];
+    fprintf(file, "%s\n    {\"bodies\": %d, \"integrator\": \"%s\", \"solver\": \"%s\", \"threads\": %d, \"stages\": {",
+            k ? "," : "", c.bodies, c.integrator.c_str(), c.solver.c_str(), c.threads);
+    for (size_t s = 0; s < c.stages.size(); s++)
+    {
+      const BenchmarkStage &stage = c.stages[s];
+      fprintf(file, "%s\n      \"%s\": {\"median\": %.9g, \"min\": %.9g, \"mean\": %.9g, \"samples\": %zu}",
+              s ? "," : "", stage.name.c_str(), stage.Median(), stage.Min(), stage.Mean(), stage.seconds.size());
+    }
+    fprintf(file, "\n    }}");
+  }
+  fprintf(file, "\n  ]\n}\n");
+  bool ok = ferror(file) == 0;
+  ok = fclose(file) == 0 && ok;
+  if (!ok)
+    printf("Could not write benchmark results %s\n", path.c_str());
+  return ok;
+}
+
+void BenchmarkReport::Print(const BenchmarkCase &c) const
+{
+  printf("%8d %-9s %-10s %2d", c.bodies, c.integrator.c_str(), c.solver.c_str(), c.threads);
+  for (size_t s = 0; s < c.stages.size(); s++)
+    printf("  %s %.3f", c.stages[s].name.c_str(), c.stages[s].Median() * 1000);
+  printf(" ms\n");
+}
+
+std::vector<std::string> SplitList(const std::string &list)
+{
+  std::vector<std::string> items;
+  size_t start = 0;
+  while (start <= list.size())
+  {
+    size_t comma = list.find(',', start);
+    if (comma == std::string::npos)
+      comma = list.size();
+    if (comma > start)
+      items.push_back(list.substr(start, comma - start));
+    start = comma + 1;
+  }
+  return items;
+}
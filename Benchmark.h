@@ -0,0 +1,55 @@
+#ifndef _BENCHMARK_H_
+#define _BENCHMARK_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//Wall clock samples of one stage of a step, in seconds
+struct BenchmarkStage
+{
+  std::string name;
+  std::vector<double> seconds;
+
+  //Median rather than mean, so one repeat the scheduler interrupted does not move the result
+  double Median() const;
+  double Min() const;
+  double Mean() const;
+};
+
+//One configuration of the suite and the timings measured for it
+struct BenchmarkCase
+{
+  int bodies;
+  std::string integrator;
+  std::string solver;
+  int threads;
+  std::vector<BenchmarkStage> stages;
+
+  //Stage called name, added on first use
+  BenchmarkStage &Stage(const std::string &name);
+};
+
+//Results of a benchmark run, written as JSON so runs can be kept and compared over time:
+//  {"version": 1, "date": ..., "compiler": ..., "optimized": ..., "isa": ..., "cores": ..., "seed": ...,
+//   "cases": [{"bodies", "integrator", "solver", "threads",
+//              "stages": {name: {"median", "min", "mean", "samples"}}}]}
+//with every time in seconds.
+class BenchmarkReport
+{
+public:
+  std::string isa;
+  uint64_t seed; //Scene seed, runs are only comparable when it matches
+  std::vector<BenchmarkCase> cases;
+
+  BenchmarkReport() : seed(0) {}
+
+  bool Write(const std::string &path) const;
+  //One line per case with the median of every stage in milliseconds
+  void Print(const BenchmarkCase &c) const;
+};
+
+//Splits a comma separated option value such as "1,2,4"; empty items are dropped
+std::vector<std::string> SplitList(const std::string &list);
+
+#endif
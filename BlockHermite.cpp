@@ -0,0 +1,215 @@
+#include "BlockHermite.h"
+#include <algorithm>
+#include <cmath>
+
+void BlockHermiteIntegrator::Forces(const Bodies &bodies, Gravity &gravity)
+{
+  switch (gravity.law.kind)
+  {
+  case LAW_PLUMMER:
+    return Forces(bodies, gravity, PlummerLaw<double>(gravity.law));
+  case LAW_SPLINE:
+    return Forces(bodies, gravity, SplineLaw<double>(gravity.law));
+  case LAW_YUKAWA:
+    return Forces(bodies, gravity, YukawaLaw<double>(gravity.law));
+  default:
+    return Forces(bodies, gravity, NewtonLaw<double>(gravity.law));
+  }
+}
+
+//Acceleration and jerk on the active bodies from the predicted state of every body.
+//With a = G m f(r2) r the jerk is G m (f v + 2 f'(r2) (r . v) r), which for Newton is the usual -3 (r . v) / r^2 term.
+template <class Law>
+void BlockHermiteIntegrator::Forces(const Bodies &bodies, Gravity &gravity, const Law &law)
+{
+  int n = bodies.size();
+  int count = active.size();
+  nax.resize(count);
+  nay.resize(count);
+  naz.resize(count);
+  njx.resize(count);
+  njy.resize(count);
+  njz.resize(count);
+  const double *m = bodies.mass.data();
+  double G = gravity.G;
+  ThreadPool::Task task = [&](int begin, int end, int) {
+    for (int k = begin; k < end; k++)
+    {
+      int i = active[k];
+      double sax = 0, say = 0, saz = 0, sjx = 0, sjy = 0, sjz = 0;
+      for (int j = 0; j < n; j++)
+      {
+        double dx = px[j] - px[i];
+        double dy = py[j] - py[i];
+        double dz = pz[j] - pz[i];
+        double r2 = dx * dx + dy * dy + dz * dz;
+        if (r2 == 0)
+          continue;
+        double dvx = pvx[j] - pvx[i];
+        double dvy = pvy[j] - pvy[i];
+        double dvz = pvz[j] - pvz[i];
+        double p;
+        double f = law.Force(r2, p);
+        double inv3 = m[j] * f;
+        double rv = -2 * law.Slope(r2, f) / f * (dx * dvx + dy * dvy + dz * dvz);
+        sax += inv3 * dx;
+        say += inv3 * dy;
+        saz += inv3 * dz;
+        sjx += inv3 * (dvx - rv * dx);
+        sjy += inv3 * (dvy - rv * dy);
+        sjz += inv3 * (dvz - rv * dz);
+      }
+      nax[k] = G * sax;
+      nay[k] = G * say;
+      naz[k] = G * saz;
+      njx[k] = G * sjx;
+      njy[k] = G * sjy;
+      njz[k] = G * sjz;
+    }
+  };
+  if (gravity.pool)
+    gravity.pool->ParallelFor(count, 16, task);
+  else
+    task(0, count, 0);
+  updates += count;
+}
+
+void BlockHermiteIntegrator::Init(Bodies &bodies, Gravity &gravity, double dt)
+{
+  int n = bodies.size();
+  blockDt = dt;
+  ax.resize(n);
+  ay.resize(n);
+  az.resize(n);
+  jx.resize(n);
+  jy.resize(n);
+  jz.resize(n);
+  px.assign(bodies.x.begin(), bodies.x.end());
+  py.assign(bodies.y.begin(), bodies.y.end());
+  pz.assign(bodies.z.begin(), bodies.z.end());
+  pvx.assign(bodies.vx.begin(), bodies.vx.end());
+  pvy.assign(bodies.vy.begin(), bodies.vy.end());
+  pvz.assign(bodies.vz.begin(), bodies.vz.end());
+  t.assign(n, 0);
+  level.assign(n, 0);
+  active.resize(n);
+  for (int i = 0; i < n; i++)
+    active[i] = i;
+  Forces(bodies, gravity);
+
+  double tick = dt / Ticks(0);
+  for (int i = 0; i < n; i++)
+  {
+    ax[i] = nax[i];
+    ay[i] = nay[i];
+    az[i] = naz[i];
+    jx[i] = njx[i];
+    jy[i] = njy[i];
+    jz[i] = njz[i];
+    //Conservative start from |a| / |j| until higher derivatives are known
+    double a = sqrt(ax[i] * ax[i] + ay[i] * ay[i] + az[i] * az[i]);
+    double j = sqrt(jx[i] * jx[i] + jy[i] * jy[i] + jz[i] * jz[i]);
+    double start = j > 0 ? 0.01 * a / j : dt;
+    int k = 0;
+    while (k < maxLevel && Ticks(k) * tick > start)
+      k++;
+    level[i] = k;
+  }
+  valid = true;
+}
+
+void BlockHermiteIntegrator::Step(Bodies &bodies, Gravity &gravity, double dt)
+{
+  int n = bodies.size();
+  updates = 0;
+  if (!valid || dt != blockDt || static_cast<int>(t.size()) != n)
+    Init(bodies, gravity, dt);
+
+  double *x = bodies.x.data(), *y = bodies.y.data(), *z = bodies.z.data();
+  double *vx = bodies.vx.data(), *vy = bodies.vy.data(), *vz = bodies.vz.data();
+  int64_t end = Ticks(0);
+  double tick = dt / end;
+  int64_t now = 0;
+  while (now < end)
+  {
+    int64_t next = end;
+    for (int i = 0; i < n; i++)
+      next = std::min(next, t[i] + Ticks(level[i]));
+    active.clear();
+    for (int i = 0; i < n; i++)
+    {
+      if (t[i] + Ticks(level[i]) == next)
+        active.push_back(i);
+    }
+
+    //Predict everyone to the block time
+    for (int i = 0; i < n; i++)
+    {
+      double h = (next - t[i]) * tick;
+      double h2 = h * h / 2, h3 = h * h * h / 6;
+      px[i] = x[i] + vx[i] * h + ax[i] * h2 + jx[i] * h3;
+      py[i] = y[i] + vy[i] * h + ay[i] * h2 + jy[i] * h3;
+      pz[i] = z[i] + vz[i] * h + az[i] * h2 + jz[i] * h3;
+      pvx[i] = vx[i] + ax[i] * h + jx[i] * h2;
+      pvy[i] = vy[i] + ay[i] * h + jy[i] * h2;
+      pvz[i] = vz[i] + az[i] * h + jz[i] * h2;
+    }
+    Forces(bodies, gravity);
+
+    for (size_t k = 0; k < active.size(); k++)
+    {
+      int i = active[k];
+      double h = Ticks(level[i]) * tick;
+      double h2 = h * h;
+      double a0[3] = {ax[i], ay[i], az[i]}, j0[3] = {jx[i], jy[i], jz[i]};
+      double a1[3] = {nax[k], nay[k], naz[k]}, j1[3] = {njx[k], njy[k], njz[k]};
+      double *pos[3] = {&x[i], &y[i], &z[i]};
+      double *vel[3] = {&vx[i], &vy[i], &vz[i]};
+      double snap2 = 0, crackle2 = 0, acc2 = 0, jerk2 = 0;
+      for (int c = 0; c < 3; c++)
+      {
+        double v0 = *vel[c];
+        double v1 = v0 + (a0[c] + a1[c]) * h / 2 + (j0[c] - j1[c]) * h2 / 12;
+        *pos[c] += (v0 + v1) * h / 2 + (a0[c] - a1[c]) * h2 / 12;
+        *vel[c] = v1;
+        //Higher derivatives from the Hermite interpolant, evaluated at the end of the step
+        double crackle = (12 * (a0[c] - a1[c]) + 6 * h * (j0[c] + j1[c])) / (h2 * h);
+        double snap = (-6 * (a0[c] - a1[c]) - h * (4 * j0[c] + 2 * j1[c])) / h2 + h * crackle;
+        snap2 += snap * snap;
+        crackle2 += crackle * crackle;
+        acc2 += a1[c] * a1[c];
+        jerk2 += j1[c] * j1[c];
+      }
+      ax[i] = a1[0];
+      ay[i] = a1[1];
+      az[i] = a1[2];
+      jx[i] = j1[0];
+      jy[i] = j1[1];
+      jz[i] = j1[2];
+      t[i] = next;
+
+      //Aarseth criterion, quantised to the block hierarchy
+      double denominator = sqrt(jerk2 * crackle2) + snap2;
+      int lv = level[i];
+      if (denominator > 0)
+      {
+        double ideal = sqrt(eta * (sqrt(acc2 * snap2) + jerk2) / denominator);
+        while (lv < maxLevel && Ticks(lv) * tick > ideal)
+          lv++;
+        //Only grow by one level at a time, and only where the coarser step lines up with the block
+        if (lv == level[i] && lv > 0 && Ticks(lv - 1) * tick <= ideal && next % Ticks(lv - 1) == 0)
+          lv--;
+      }
+      level[i] = lv;
+    }
+    now = next;
+  }
+
+  for (int i = 0; i < n; i++)
+  {
+    t[i] = 0;
+    bodies.ax[i] = ax[i];
+    bodies.ay[i] = ay[i];
+    bodies.az[i] = az[i];
+  }
+}
@@ -0,0 +1,41 @@
+#ifndef _BLOCKHERMITE_H_
+#define _BLOCKHERMITE_H_
+
+#include "Integrator.h"
+#include <cstdint>
+
+//Fourth order Hermite predictor-corrector with individual block time steps.
+//Each body steps at dt / 2^level, with the level picked from the Aarseth acceleration/jerk criterion,
+//so only bodies in close encounters are sub-stepped. All bodies are synchronised again at the end of every Step().
+//Forces and jerks are direct sums over every body, split across gravity.pool: gravity.solver and the vector kernels
+//are not used, so this suits small systems with close encounters rather than large scenes.
+class BlockHermiteIntegrator : public Integrator
+{
+private:
+  AlignedDoubles ax, ay, az, jx, jy, jz;       //Acceleration and jerk at each body's own time
+  AlignedDoubles px, py, pz, pvx, pvy, pvz;    //Positions and velocities predicted to the current block time
+  AlignedDoubles nax, nay, naz, njx, njy, njz; //Fresh forces for the active bodies
+  std::vector<int64_t> t;                      //Body time in ticks of dt / 2^maxLevel
+  std::vector<int> level;
+  std::vector<int> active;
+  double blockDt;
+  bool valid;
+
+  void Init(Bodies &bodies, Gravity &gravity, double dt);
+  void Forces(const Bodies &bodies, Gravity &gravity);
+  template <class Law>
+  void Forces(const Bodies &bodies, Gravity &gravity, const Law &law);
+  int64_t Ticks(int k) const { return int64_t(1) << (maxLevel - k); }
+
+public:
+  double eta;       //Accuracy parameter of the time step criterion
+  int maxLevel;     //Deepest subdivision of the block step
+  long long updates; //Body force evaluations during the last Step()
+
+  BlockHermiteIntegrator() : blockDt(0), valid(false), eta(0.02), maxLevel(20), updates(0) {}
+  const char *Name() const { return "block"; }
+  void Step(Bodies &bodies, Gravity &gravity, double dt);
+  void Reset() { valid = false; }
+};
+
+#endif
@@ -0,0 +1,136 @@
+#include "Bodies.h"
+
+Bodies::Bodies() : nextId(0)
+{
+}
+
+size_t Bodies::Add(double m, double px, double py, double pz, double pvx, double pvy, double pvz)
+{
+  mass.push_back(m);
+  x.push_back(px);
+  y.push_back(py);
+  z.push_back(pz);
+  vx.push_back(pvx);
+  vy.push_back(pvy);
+  vz.push_back(pvz);
+  ax.push_back(0);
+  ay.push_back(0);
+  az.push_back(0);
+  id.push_back(nextId++);
+  return mass.size() - 1;
+}
+
+size_t Bodies::Append(size_t n)
+{
+  size_t first = mass.size();
+  size_t size = first + n;
+  mass.resize(size);
+  x.resize(size);
+  y.resize(size);
+  z.resize(size);
+  vx.resize(size);
+  vy.resize(size);
+  vz.resize(size);
+  ax.resize(size);
+  ay.resize(size);
+  az.resize(size);
+  id.resize(size);
+  for (size_t i = first; i < size; i++)
+    id[i] = nextId++;
+  return first;
+}
+
+//Drops every body whose keep flag is zero in a single stable pass
+void Bodies::Compact(const std::vector<char> &keep)
+{
+  size_t n = mass.size();
+  size_t out = 0;
+  for (size_t i = 0; i < n; i++)
+  {
+    if (!keep[i])
+      continue;
+    if (out != i)
+    {
+      mass[out] = mass[i];
+      x[out] = x[i];
+      y[out] = y[i];
+      z[out] = z[i];
+      vx[out] = vx[i];
+      vy[out] = vy[i];
+      vz[out] = vz[i];
+      ax[out] = ax[i];
+      ay[out] = ay[i];
+      az[out] = az[i];
+      id[out] = id[i];
+    }
+    out++;
+  }
+  mass.resize(out);
+  x.resize(out);
+  y.resize(out);
+  z.resize(out);
+  vx.resize(out);
+  vy.resize(out);
+  vz.resize(out);
+  ax.resize(out);
+  ay.resize(out);
+  az.resize(out);
+  id.resize(out);
+}
+
+void Bodies::Reserve(size_t n)
+{
+  mass.reserve(n);
+  x.reserve(n);
+  y.reserve(n);
+  z.reserve(n);
+  vx.reserve(n);
+  vy.reserve(n);
+  vz.reserve(n);
+  ax.reserve(n);
+  ay.reserve(n);
+  az.reserve(n);
+  id.reserve(n);
+}
+
+void Bodies::Clear()
+{
+  mass.clear();
+  x.clear();
+  y.clear();
+  z.clear();
+  vx.clear();
+  vy.clear();
+  vz.clear();
+  ax.clear();
+  ay.clear();
+  az.clear();
+  id.clear();
+}
+
+void Bodies::Assign(size_t n, const uint64_t *ids, const double *m, const double *px, const double *py, const double *pz,
+                    const double *pvx, const double *pvy, const double *pvz, uint64_t next)
+{
+  mass.assign(m, m + n);
+  x.assign(px, px + n);
+  y.assign(py, py + n);
+  z.assign(pz, pz + n);
+  vx.assign(pvx, pvx + n);
+  vy.assign(pvy, pvy + n);
+  vz.assign(pvz, pvz + n);
+  ax.assign(n, 0);
+  ay.assign(n, 0);
+  az.assign(n, 0);
+  id.assign(ids, ids + n);
+  nextId = next;
+}
+
+long Bodies::IndexOf(uint64_t bodyId) const
+{
+  for (size_t i = 0; i < id.size(); i++)
+  {
+    if (id[i] == bodyId)
+      return static_cast<long>(i);
+  }
+  return -1;
+}
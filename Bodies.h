@@ -0,0 +1,92 @@
+#ifndef _BODIES_H_
+#define _BODIES_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+//Allocator that keeps body arrays on cache line boundaries so the force loops get aligned vector loads
+template <typename T, size_t Align = 64>
+struct AlignedAllocator
+{
+  typedef T value_type;
+
+  template <typename U>
+  struct rebind
+  {
+    typedef AlignedAllocator<U, Align> other;
+  };
+
+  AlignedAllocator() {}
+  template <typename U>
+  AlignedAllocator(const AlignedAllocator<U, Align> &) {}
+
+  T *allocate(size_t n)
+  {
+    if (n == 0)
+      return nullptr;
+    void *p = nullptr;
+#ifdef _WIN32
+    p = _aligned_malloc(n * sizeof(T), Align);
+#else
+    if (posix_memalign(&p, Align, n * sizeof(T)) != 0)
+      p = nullptr;
+#endif
+    if (p == nullptr)
+      throw std::bad_alloc();
+    return static_cast<T *>(p);
+  }
+
+  void deallocate(T *p, size_t)
+  {
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+  }
+};
+
+template <typename T, typename U, size_t A>
+bool operator==(const AlignedAllocator<T, A> &, const AlignedAllocator<U, A> &) { return true; }
+template <typename T, typename U, size_t A>
+bool operator!=(const AlignedAllocator<T, A> &, const AlignedAllocator<U, A> &) { return false; }
+
+typedef std::vector<double, AlignedAllocator<double>> AlignedDoubles;
+typedef std::vector<float, AlignedAllocator<float>> AlignedFloats;
+
+//Structure of arrays body store: one contiguous array per component, indexed by body
+class Bodies
+{
+public:
+  AlignedDoubles mass;
+  AlignedDoubles x, y, z;
+  AlignedDoubles vx, vy, vz;
+  AlignedDoubles ax, ay, az;
+  std::vector<uint64_t> id;
+
+  Bodies();
+
+  size_t Add(double m, double px, double py, double pz, double pvx, double pvy, double pvz);
+  //Grows every column by n zeroed bodies with fresh ids and returns the index of the first, for generators
+  //that fill the new bodies in parallel
+  size_t Append(size_t n);
+  void Compact(const std::vector<char> &keep);
+  void Reserve(size_t n);
+  void Clear();
+  long IndexOf(uint64_t bodyId) const;
+  //Replaces the contents with n bodies copied from column arrays, as read from a snapshot
+  void Assign(size_t n, const uint64_t *ids, const double *m, const double *px, const double *py, const double *pz,
+              const double *pvx, const double *pvy, const double *pvz, uint64_t next);
+  uint64_t NextId() const { return nextId; }
+
+  size_t Size() const { return mass.size(); }
+  size_t size() const { return mass.size(); }
+
+private:
+  uint64_t nextId;
+};
+
+#endif
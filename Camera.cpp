@@ -0,0 +1,115 @@
+#include "Camera.h"
+#include <cmath>
+
+Quaternion Quaternion::Identity()
+{
+  Quaternion q = {1, 0, 0, 0};
+  return q;
+}
+
+Quaternion Quaternion::AxisAngle(double ax, double ay, double az, double angle)
+{
+  double len = sqrt(ax * ax + ay * ay + az * az);
+  if (len == 0)
+    return Identity();
+  double s = sin(angle / 2) / len;
+  Quaternion q = {cos(angle / 2), ax * s, ay * s, az * s};
+  return q;
+}
+
+Quaternion Quaternion::operator*(const Quaternion &o) const
+{
+  Quaternion r = {w * o.w - x * o.x - y * o.y - z * o.z,
+                  w * o.x + x * o.w + y * o.z - z * o.y,
+                  w * o.y - x * o.z + y * o.w + z * o.x,
+                  w * o.z + x * o.y - y * o.x + z * o.w};
+  return r;
+}
+
+void Quaternion::Normalize()
+{
+  double len = sqrt(w * w + x * x + y * y + z * z);
+  if (len == 0)
+  {
+    *this = Identity();
+    return;
+  }
+  w /= len;
+  x /= len;
+  y /= len;
+  z /= len;
+}
+
+Matrix4 Quaternion::ToMatrix() const
+{
+  Matrix4 r = {{1 - 2 * (y * y + z * z), 2 * (x * y - w * z), 2 * (x * z + w * y), 0,
+                2 * (x * y + w * z), 1 - 2 * (x * x + z * z), 2 * (y * z - w * x), 0,
+                2 * (x * z - w * y), 2 * (y * z + w * x), 1 - 2 * (x * x + y * y), 0,
+                0, 0, 0, 1}};
+  return r;
+}
+
+Camera::Camera() : orientation(Quaternion::Identity()), scalex(1), scaley(1), viewDirty(true), screenZoom(1), screenDirty(true)
+{
+  screenPan[0] = screenPan[1] = 0;
+  screenSize[0] = screenSize[1] = 0;
+}
+
+void Camera::SetEuler(double xang, double yang, double zang)
+{
+  SetOrientation(Quaternion::AxisAngle(0, 0, 1, zang) * Quaternion::AxisAngle(1, 0, 0, xang) * Quaternion::AxisAngle(0, 1, 0, yang));
+}
+
+void Camera::RotateLocal(double ax, double ay, double az, double angle)
+{
+  SetOrientation(Quaternion::AxisAngle(ax, ay, az, angle) * orientation);
+}
+
+void Camera::RotateWorld(double ax, double ay, double az, double angle)
+{
+  SetOrientation(orientation * Quaternion::AxisAngle(ax, ay, az, angle));
+}
+
+void Camera::SetOrientation(const Quaternion &q)
+{
+  orientation = q;
+  //Renormalise so repeated small rotations do not drift into a scaling
+  orientation.Normalize();
+  viewDirty = true;
+}
+
+void Camera::SetScale(double sx, double sy)
+{
+  if (sx == scalex && sy == scaley)
+    return;
+  scalex = sx;
+  scaley = sy;
+  viewDirty = true;
+}
+
+const Matrix4 &Camera::View()
+{
+  if (viewDirty)
+  {
+    view = Matrix4::Scale(scalex, scaley, 1) * orientation.ToMatrix();
+    viewDirty = false;
+    screenDirty = true;
+  }
+  return view;
+}
+
+const Matrix4 &Camera::Screen(double panx, double pany, double zoom, int width, int height)
+{
+  View();
+  if (screenDirty || panx != screenPan[0] || pany != screenPan[1] || zoom != screenZoom || width != screenSize[0] || height != screenSize[1])
+  {
+    screenPan[0] = panx;
+    screenPan[1] = pany;
+    screenZoom = zoom;
+    screenSize[0] = width;
+    screenSize[1] = height;
+    screen = Matrix4::Translation(width / 2, height / 2, 0) * Matrix4::Scale(zoom, zoom, 1) * Matrix4::Translation(panx, pany, 0) * view;
+    screenDirty = false;
+  }
+  return screen;
+}
@@ -0,0 +1,53 @@
+#ifndef _CAMERA_H_
+#define _CAMERA_H_
+
+#include "Transform.h"
+
+//Unit quaternion orientation, w + xi + yj + zk
+struct Quaternion
+{
+  double w, x, y, z;
+
+  static Quaternion Identity();
+  //Rotation by angle radians about the given axis, which need not be normalised
+  static Quaternion AxisAngle(double ax, double ay, double az, double angle);
+
+  Quaternion operator*(const Quaternion &other) const;
+  void Normalize();
+  Matrix4 ToMatrix() const;
+};
+
+//Orientation and perspective scale of the view; the combined matrices are only rebuilt when an input changes
+class Camera
+{
+public:
+  Camera();
+
+  //Same convention as the old xang/yang/zang rotations: y first, then x, then z
+  void SetEuler(double xang, double yang, double zang);
+  //Rotates about an axis fixed to the view, e.g. pitch, yaw or roll for free-look
+  void RotateLocal(double ax, double ay, double az, double angle);
+  //Rotates the world under the view about a world axis
+  void RotateWorld(double ax, double ay, double az, double angle);
+  void SetOrientation(const Quaternion &q);
+  const Quaternion &Orientation() const { return orientation; }
+  void SetScale(double sx, double sy);
+
+  //World to the projection plane
+  const Matrix4 &View();
+  //World to pixels: the view followed by panning by (panx, pany), zoom and centring on the screen
+  const Matrix4 &Screen(double panx, double pany, double zoom, int width, int height);
+
+private:
+  Quaternion orientation;
+  double scalex, scaley;
+  Matrix4 view;
+  bool viewDirty;
+
+  Matrix4 screen;
+  double screenPan[2], screenZoom;
+  int screenSize[2];
+  bool screenDirty;
+};
+
+#endif
@@ -0,0 +1,62 @@
+#include "CameraScript.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+bool CameraScript::Load(const std::string &path)
+{
+  keys.clear();
+  std::ifstream file(path.c_str());
+  if (!file)
+  {
+    printf("Could not open camera script %s\n", path.c_str());
+    return false;
+  }
+  std::string line;
+  int number = 0;
+  while (std::getline(file, line))
+  {
+    number++;
+    size_t first = line.find_first_not_of(" \t\r");
+    if (first == std::string::npos || line[first] == '#')
+      continue;
+    std::istringstream fields(line);
+    CameraKey key;
+    key.zang = 0;
+    if (!(fields >> key.step >> key.posx >> key.posy >> key.zoom >> key.xang >> key.yang) || key.zoom <= 0)
+    {
+      printf("%s:%d: expected step posx posy zoom xang yang [zang]\n", path.c_str(), number);
+      keys.clear();
+      return false;
+    }
+    fields >> key.zang;
+    keys.push_back(key);
+  }
+  std::stable_sort(keys.begin(), keys.end(), [](const CameraKey &a, const CameraKey &b) { return a.step < b.step; });
+  return true;
+}
+
+CameraKey CameraScript::At(long step) const
+{
+  if (step <= keys.front().step)
+    return keys.front();
+  if (step >= keys.back().step)
+    return keys.back();
+  size_t k = 1;
+  while (keys[k].step < step)
+    k++;
+  const CameraKey &a = keys[k - 1];
+  const CameraKey &b = keys[k];
+  double t = b.step == a.step ? 1 : static_cast<double>(step - a.step) / (b.step - a.step);
+  CameraKey key;
+  key.step = step;
+  key.posx = a.posx + (b.posx - a.posx) * t;
+  key.posy = a.posy + (b.posy - a.posy) * t;
+  key.zoom = a.zoom * pow(b.zoom / a.zoom, t);
+  key.xang = a.xang + (b.xang - a.xang) * t;
+  key.yang = a.yang + (b.yang - a.yang) * t;
+  key.zang = a.zang + (b.zang - a.zang) * t;
+  return key;
+}
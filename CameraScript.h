@@ -0,0 +1,30 @@
+#ifndef _CAMERASCRIPT_H_
+#define _CAMERASCRIPT_H_
+
+#include <string>
+#include <vector>
+
+//View state at one step of a camera script
+struct CameraKey
+{
+  long step;
+  double posx, posy, zoom;
+  double xang, yang, zang;
+};
+
+//Keyframed camera path read from a text file, one key per line:
+//  step posx posy zoom xang yang [zang]
+//Blank lines and lines starting with # are skipped. Between keys the pan and angles are interpolated
+//linearly and the zoom geometrically, so a zoom-in runs at a steady rate; outside the keys the nearest one holds.
+class CameraScript
+{
+public:
+  bool Load(const std::string &path);
+  bool Empty() const { return keys.empty(); }
+  CameraKey At(long step) const;
+
+private:
+  std::vector<CameraKey> keys;
+};
+
+#endif
@@ -0,0 +1,218 @@
+#include "Collisions.h"
+#include <algorithm>
+#include <cmath>
+
+static inline uint64_t CellKey(long long ix, long long iy, long long iz)
+{
+  //21 bits per axis is plenty once the coordinates are wrapped into the table
+  return (static_cast<uint64_t>(ix) & 0x1FFFFF) | ((static_cast<uint64_t>(iy) & 0x1FFFFF) << 21) | ((static_cast<uint64_t>(iz) & 0x1FFFFF) << 42);
+}
+
+static inline uint64_t HashKey(uint64_t key, int level)
+{
+  key ^= static_cast<uint64_t>(level) * 0x9e3779b97f4a7c15ULL;
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  return key;
+}
+
+Collisions::Collisions() : levels(0), maxPasses(8)
+{
+}
+
+int Collisions::Find(int i)
+{
+  while (parent[i] != i)
+  {
+    parent[i] = parent[parent[i]];
+    i = parent[i];
+  }
+  return i;
+}
+
+int Collisions::Merge(Bodies &bodies, double mpp, int &followObject)
+{
+  int total = 0;
+  //Merged bodies grow, so repeat until nothing new overlaps
+  for (int pass = 0; pass < maxPasses; pass++)
+  {
+    int merged = Pass(bodies, mpp, followObject);
+    total += merged;
+    if (merged == 0)
+      break;
+  }
+  return total;
+}
+
+int Collisions::Pass(Bodies &bodies, double mpp, int &followObject)
+{
+  int n = bodies.size();
+  if (n < 2)
+    return 0;
+  const double *m = bodies.mass.data();
+  const double *x = bodies.x.data();
+  const double *y = bodies.y.data();
+  const double *z = bodies.z.data();
+
+  //Each body goes on the first level whose cell is at least twice its diameter, with cells doubling from level to
+  //level. A partner on the same or a coarser level is then closer than half that level's cell in every axis, so only
+  //the 2x2x2 cells nearest the body can hold it. Level 0 is sized from the median diameter, so one heavy body sits
+  //alone on a coarse level instead of coarsening the grid for all the others.
+  sizes.clear();
+  double largest = 0;
+  for (int i = 0; i < n; i++)
+  {
+    double d = m[i] / mpp;
+    if (d > 0)
+    {
+      sizes.push_back(d);
+      largest = std::max(largest, d);
+    }
+  }
+  if (sizes.empty())
+    return 0;
+  std::nth_element(sizes.begin(), sizes.begin() + sizes.size() / 2, sizes.end());
+  double base = std::max(2 * sizes[sizes.size() / 2], ldexp(largest, -MaxLevels)); //Largest diameter on level 0
+
+  levels = 0;
+  level.resize(n);
+  for (int i = 0; i < n; i++)
+  {
+    double d = m[i] / mpp;
+    int l = d > base ? static_cast<int>(ceil(log2(d / base))) : 0;
+    while (l < MaxLevels && ldexp(base, l) < d)
+      l++;
+    level[i] = l;
+    levels = std::max(levels, l + 1);
+  }
+  for (int l = 0; l < levels; l++)
+    inv[l] = 1 / ldexp(2 * base, l);
+  levelStart.assign(levels + 1, 0);
+  for (int i = 0; i < n; i++)
+    levelStart[level[i] + 1]++;
+  for (int l = 0; l < levels; l++)
+    levelStart[l + 1] += levelStart[l];
+  remap.assign(levelStart.begin(), levelStart.end() - 1);
+  byLevel.resize(n);
+  for (int i = 0; i < n; i++)
+    byLevel[remap[level[i]]++] = i;
+
+  int buckets = 1;
+  while (buckets < 2 * n)
+    buckets <<= 1;
+  uint64_t mask = buckets - 1;
+
+  keys.resize(n);
+  order.resize(n);
+  bucketStart.assign(buckets + 1, 0);
+  for (int i = 0; i < n; i++)
+  {
+    double s = inv[level[i]];
+    keys[i] = CellKey(static_cast<long long>(floor(x[i] * s)), static_cast<long long>(floor(y[i] * s)), static_cast<long long>(floor(z[i] * s)));
+    bucketStart[(HashKey(keys[i], level[i]) & mask) + 1]++;
+  }
+  for (int b = 0; b < buckets; b++)
+    bucketStart[b + 1] += bucketStart[b];
+  remap.assign(bucketStart.begin(), bucketStart.end() - 1);
+  for (int i = 0; i < n; i++)
+    order[remap[HashKey(keys[i], level[i]) & mask]++] = i;
+
+  parent.resize(n);
+  for (int i = 0; i < n; i++)
+    parent[i] = i;
+
+  int pairs = 0;
+  for (int i = 0; i < n; i++)
+  {
+    double ri = m[i] / mpp / 2;
+    auto touch = [&](int j) {
+      double rx = x[j] - x[i];
+      double ry = y[j] - y[i];
+      double rz = z[j] - z[i];
+      double reach = ri + m[j] / mpp / 2;
+      if (rx * rx + ry * ry + rz * rz < reach * reach)
+      {
+        int a = Find(i);
+        int c = Find(j);
+        if (a != c)
+        {
+          //The lower index always survives
+          if (a < c)
+            parent[c] = a;
+          else
+            parent[a] = c;
+          pairs++;
+        }
+      }
+    };
+    //Partners on finer levels find i themselves
+    for (int l = level[i]; l < levels; l++)
+    {
+      int first = levelStart[l], last = levelStart[l + 1];
+      if (last - first <= 8)
+      {
+        //A sparse level is cheaper to scan than to look up
+        for (int k = first; k < last; k++)
+        {
+          int j = byLevel[k];
+          if (l != level[i] || j > i)
+            touch(j);
+        }
+        continue;
+      }
+      long long cell[3], step[3];
+      double p[3] = {x[i] * inv[l], y[i] * inv[l], z[i] * inv[l]};
+      for (int a = 0; a < 3; a++)
+      {
+        double f = floor(p[a]);
+        cell[a] = static_cast<long long>(f);
+        step[a] = p[a] - f < 0.5 ? -1 : 1;
+      }
+      for (int corner = 0; corner < 8; corner++)
+      {
+        uint64_t key = CellKey(cell[0] + (corner & 1 ? step[0] : 0), cell[1] + (corner & 2 ? step[1] : 0),
+                               cell[2] + (corner & 4 ? step[2] : 0));
+        uint64_t b = HashKey(key, l) & mask;
+        for (int k = bucketStart[b]; k < bucketStart[b + 1]; k++)
+        {
+          int j = order[k];
+          if (keys[j] == key && level[j] == l && (l != level[i] || j > i))
+            touch(j);
+        }
+      }
+    }
+  }
+  if (pairs == 0)
+    return 0;
+
+  //Fold every absorbed body into its survivor, then compact once
+  double *mm = bodies.mass.data();
+  double *vx = bodies.vx.data();
+  double *vy = bodies.vy.data();
+  double *vz = bodies.vz.data();
+  keep.assign(n, 1);
+  for (int i = 0; i < n; i++)
+  {
+    int root = Find(i);
+    if (root == i)
+      continue;
+    keep[i] = 0;
+    double total = mm[root] + mm[i];
+    vx[root] = (mm[root] * vx[root] + mm[i] * vx[i]) / total;
+    vy[root] = (mm[root] * vy[root] + mm[i] * vy[i]) / total;
+    vz[root] = (mm[root] * vz[root] + mm[i] * vz[i]) / total;
+    mm[root] = total;
+  }
+
+  if (followObject >= 0 && followObject < n)
+  {
+    int target = Find(followObject);
+    int index = 0;
+    for (int i = 0; i < target; i++)
+      index += keep[i];
+    followObject = index;
+  }
+  bodies.Compact(keep);
+  return pairs;
+}
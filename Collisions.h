@@ -0,0 +1,40 @@
+#ifndef _COLLISIONS_H_
+#define _COLLISIONS_H_
+
+#include "Bodies.h"
+
+//Merges overlapping bodies using a hierarchical spatial hash broad phase: cell sizes double from level to level,
+//starting from the typical diameter, so one heavy body does not coarsen the grid for all the others.
+//Bodies have radius mass / mpp / 2. Every overlapping group collapses into its lowest index member,
+//which keeps its position and takes the summed mass and momentum.
+class Collisions
+{
+private:
+  static const int MaxLevels = 40;
+
+  std::vector<uint64_t> keys;
+  std::vector<double> sizes;
+  std::vector<int> level; //Hash level of each body
+  std::vector<int> levelStart;
+  std::vector<int> byLevel; //Body indices grouped by level
+  double inv[MaxLevels + 1]; //Inverse cell size per level
+  int levels;
+  std::vector<int> bucketStart;
+  std::vector<int> order;
+  std::vector<int> parent;
+  std::vector<char> keep;
+  std::vector<int> remap;
+
+  int Find(int i);
+  int Pass(Bodies &bodies, double mpp, int &followObject);
+
+public:
+  int maxPasses;
+
+  Collisions();
+
+  //Returns the number of bodies absorbed; followObject is moved to the index of whatever body now holds it
+  int Merge(Bodies &bodies, double mpp, int &followObject);
+};
+
+#endif
@@ -0,0 +1,159 @@
+#include "Diagnostics.h"
+#include <algorithm>
+#include <cmath>
+
+Diagnostics::Diagnostics() : every(100), file(nullptr), sampling(false), pendingStep(0), pendingTime(0), samples(0),
+                             energyDrift(0), momentumDrift(0), angularDrift(0)
+{
+}
+
+Diagnostics::~Diagnostics()
+{
+  Close();
+}
+
+bool Diagnostics::Open(const std::string &path)
+{
+  Close();
+  file = fopen(path.c_str(), "w");
+  if (file == nullptr)
+  {
+    printf("Could not write diagnostics %s\n", path.c_str());
+    return false;
+  }
+  fprintf(file, "step,time,bodies,kinetic,potential,energy,energy_drift,px,py,pz,momentum_drift,lx,ly,lz,angular_drift\n");
+  samples = 0;
+  energyDrift = momentumDrift = angularDrift = 0;
+  return true;
+}
+
+void Diagnostics::Close()
+{
+  if (file != nullptr)
+    fclose(file);
+  file = nullptr;
+}
+
+void Diagnostics::Motion(const Bodies &bodies, Conserved &c)
+{
+  c.kinetic = c.px = c.py = c.pz = c.lx = c.ly = c.lz = 0;
+  size_t n = bodies.size();
+  for (size_t i = 0; i < n; i++)
+  {
+    double m = bodies.mass[i];
+    double x = bodies.x[i], y = bodies.y[i], z = bodies.z[i];
+    double vx = bodies.vx[i], vy = bodies.vy[i], vz = bodies.vz[i];
+    c.kinetic += 0.5 * m * (vx * vx + vy * vy + vz * vz);
+    c.px += m * vx;
+    c.py += m * vy;
+    c.pz += m * vz;
+    c.lx += m * (y * vz - z * vy);
+    c.ly += m * (z * vx - x * vz);
+    c.lz += m * (x * vy - y * vx);
+  }
+}
+
+double Diagnostics::Potential(const Bodies &bodies, const AlignedDoubles &phi)
+{
+  double sum = 0;
+  size_t n = std::min(bodies.size(), phi.size());
+  for (size_t i = 0; i < n; i++)
+    sum += bodies.mass[i] * phi[i];
+  return sum / 2;
+}
+
+void Diagnostics::BeforeStep(Bodies &bodies, Gravity &gravity, const Integrator &integrator, long step, double time)
+{
+  sampling = false;
+  if (file == nullptr)
+    return;
+  ForceTiming timing = integrator.Timing();
+  if (timing == FORCES_AT_START && step % every == 0)
+  {
+    //The step's only pass sees these positions, so pair it with the velocities from before the kick
+    Motion(bodies, pending);
+    pendingStep = step;
+    pendingTime = time;
+    gravity.potential = true;
+    sampling = true;
+  }
+  else if (timing == FORCES_AT_END && (step + 1) % every == 0)
+  {
+    gravity.potential = true;
+    sampling = true;
+  }
+}
+
+void Diagnostics::AfterStep(Bodies &bodies, Gravity &gravity, const Integrator &integrator, long step, double time)
+{
+  if (file == nullptr)
+    return;
+  gravity.potential = false;
+  ForceTiming timing = integrator.Timing();
+  if (timing == FORCES_AT_START)
+  {
+    if (sampling)
+    {
+      pending.potential = Potential(bodies, gravity.phi);
+      Write(bodies, pending, pendingStep, pendingTime);
+    }
+  }
+  else if (timing == FORCES_AT_END)
+  {
+    if (sampling)
+    {
+      Motion(bodies, pending);
+      pending.potential = Potential(bodies, gravity.phi);
+      Write(bodies, pending, step, time);
+    }
+  }
+  else if (step % every == 0)
+  {
+    //The integrator keeps its forces in the body arrays between steps, so they are put back after the extra pass
+    ax.assign(bodies.ax.begin(), bodies.ax.end());
+    ay.assign(bodies.ay.begin(), bodies.ay.end());
+    az.assign(bodies.az.begin(), bodies.az.end());
+    gravity.potential = true;
+    gravity.Accelerations(bodies);
+    gravity.potential = false;
+    bodies.ax.swap(ax);
+    bodies.ay.swap(ay);
+    bodies.az.swap(az);
+    Motion(bodies, pending);
+    pending.potential = Potential(bodies, gravity.phi);
+    Write(bodies, pending, step, time);
+  }
+  sampling = false;
+}
+
+void Diagnostics::Write(const Bodies &bodies, const Conserved &c, long step, double time)
+{
+  if (samples == 0)
+  {
+    first = c;
+    momentumScale = angularScale = 0;
+    for (size_t i = 0; i < bodies.size(); i++)
+    {
+      double m = bodies.mass[i];
+      double v = sqrt(bodies.vx[i] * bodies.vx[i] + bodies.vy[i] * bodies.vy[i] + bodies.vz[i] * bodies.vz[i]);
+      double r = sqrt(bodies.x[i] * bodies.x[i] + bodies.y[i] * bodies.y[i] + bodies.z[i] * bodies.z[i]);
+      momentumScale += m * v;
+      angularScale += m * r * v;
+    }
+  }
+  samples++;
+
+  double e0 = first.Energy();
+  double de = e0 != 0 ? fabs((c.Energy() - e0) / e0) : fabs(c.Energy());
+  double dp = sqrt((c.px - first.px) * (c.px - first.px) + (c.py - first.py) * (c.py - first.py) + (c.pz - first.pz) * (c.pz - first.pz));
+  double dl = sqrt((c.lx - first.lx) * (c.lx - first.lx) + (c.ly - first.ly) * (c.ly - first.ly) + (c.lz - first.lz) * (c.lz - first.lz));
+  dp = momentumScale > 0 ? dp / momentumScale : dp;
+  dl = angularScale > 0 ? dl / angularScale : dl;
+  energyDrift = std::max(energyDrift, de);
+  momentumDrift = std::max(momentumDrift, dp);
+  angularDrift = std::max(angularDrift, dl);
+
+  fprintf(file, "%ld,%.17g,%zu,%.17g,%.17g,%.17g,%.6e,%.17g,%.17g,%.17g,%.6e,%.17g,%.17g,%.17g,%.6e\n", step, time,
+          bodies.size(), c.kinetic, c.potential, c.Energy(), de, c.px, c.py, c.pz, dp, c.lx, c.ly, c.lz, dl);
+  fflush(file);
+}
@@ -0,0 +1,64 @@
+#ifndef _DIAGNOSTICS_H_
+#define _DIAGNOSTICS_H_
+
+#include "Bodies.h"
+#include "Gravity.h"
+#include "Integrator.h"
+#include <cstdio>
+#include <string>
+
+//Conserved quantities of the whole system at one instant
+struct Conserved
+{
+  double kinetic, potential;
+  double px, py, pz; //Linear momentum
+  double lx, ly, lz; //Angular momentum about the origin
+
+  double Energy() const { return kinetic + potential; }
+};
+
+//Samples energy, momentum and angular momentum every few steps and logs them as CSV with their drift from the
+//first sample. The potential is taken from the step's own force pass when the integrator's ForceTiming allows,
+//so a sample adds only O(N) sums; other integrators get one extra force pass per sample, with the same solver.
+class Diagnostics
+{
+public:
+  long every; //Steps between samples
+
+  Diagnostics();
+  ~Diagnostics();
+
+  bool Open(const std::string &path);
+  void Close();
+  bool IsOpen() const { return file != nullptr; }
+
+  //Around every integrator step; step and time are the values before and after it
+  void BeforeStep(Bodies &bodies, Gravity &gravity, const Integrator &integrator, long step, double time);
+  void AfterStep(Bodies &bodies, Gravity &gravity, const Integrator &integrator, long step, double time);
+
+  long Samples() const { return samples; }
+  //Largest relative drifts seen so far
+  double EnergyDrift() const { return energyDrift; }
+  double MomentumDrift() const { return momentumDrift; }
+  double AngularDrift() const { return angularDrift; }
+
+  //Kinetic energy, momentum and angular momentum; leaves potential alone
+  static void Motion(const Bodies &bodies, Conserved &c);
+  //Half of sum m_i phi_i, each pair counted once
+  static double Potential(const Bodies &bodies, const AlignedDoubles &phi);
+
+private:
+  FILE *file;
+  Conserved first, pending;
+  double momentumScale, angularScale; //Sums of |m v| and |m r| |v| at the first sample, as momenta may start at zero
+  bool sampling;
+  long pendingStep;
+  double pendingTime;
+  long samples;
+  double energyDrift, momentumDrift, angularDrift;
+  AlignedDoubles ax, ay, az;
+
+  void Write(const Bodies &bodies, const Conserved &c, long step, double time);
+};
+
+#endif
@@ -0,0 +1,474 @@
+#include "Fmm.h"
+#include <algorithm>
+#include <cmath>
+
+static const int MaxTerms = (Fmm::MaxOrder + 1) * (Fmm::MaxOrder + 2) * (Fmm::MaxOrder + 3) / 6 + 1;
+
+static double Binomial(int n, int k)
+{
+  double b = 1;
+  for (int i = 1; i <= k; i++)
+    b = b * (n - k + i) / i;
+  return b;
+}
+
+Fmm::Fmm() : order(4), theta(0.5), isa(DetectIsa()), splitDepth(1), tableOrder(-1), terms(0)
+{
+  //Expansions make the far field cheap, so leaves can hold more bodies than Barnes-Hut uses
+  tree.leafSize = 64;
+}
+
+//Terms are ordered by total degree, then by descending x and y exponent
+int Fmm::Term(int nx, int ny, int nz) const
+{
+  int d = nx + ny + nz;
+  return d * (d + 1) * (d + 2) / 6 + (d - nx) * (d - nx + 1) / 2 + (d - nx - ny);
+}
+
+void Fmm::Tables()
+{
+  tableOrder = order;
+  ex.clear();
+  ey.clear();
+  ez.clear();
+  degree.clear();
+  for (int d = 0; d <= order; d++)
+  {
+    for (int nx = d; nx >= 0; nx--)
+    {
+      for (int ny = d - nx; ny >= 0; ny--)
+      {
+        ex.push_back(nx);
+        ey.push_back(ny);
+        ez.push_back(d - nx - ny);
+        degree.push_back(d);
+      }
+    }
+  }
+  terms = ex.size();
+
+  for (int a = 0; a < 3; a++)
+  {
+    down[a].assign(terms, -1);
+    down2[a].assign(terms, -1);
+  }
+  prevTerm.assign(terms, -1);
+  prevAxis.assign(terms, 0);
+  first.resize(terms);
+  second.resize(terms);
+  for (int t = 1; t < terms; t++)
+  {
+    first[t] = (2.0 * degree[t] - 1) / degree[t];
+    second[t] = (degree[t] - 1.0) / degree[t];
+  }
+  for (int t = 0; t < terms; t++)
+  {
+    int n[3] = {ex[t], ey[t], ez[t]};
+    for (int a = 0; a < 3; a++)
+    {
+      int m[3] = {n[0], n[1], n[2]};
+      if (n[a] >= 1)
+      {
+        m[a] = n[a] - 1;
+        down[a][t] = Term(m[0], m[1], m[2]);
+        if (prevTerm[t] < 0)
+        {
+          prevTerm[t] = down[a][t];
+          prevAxis[t] = a;
+        }
+      }
+      if (n[a] >= 2)
+      {
+        m[a] = n[a] - 2;
+        down2[a][t] = Term(m[0], m[1], m[2]);
+      }
+    }
+  }
+
+  for (int a = 0; a < 3; a++)
+  {
+    lower[a] = down[a];
+    lower2[a] = down2[a];
+    std::replace(lower[a].begin(), lower[a].end(), -1, terms);
+    std::replace(lower2[a].begin(), lower2[a].end(), -1, terms);
+  }
+
+  //Q_n(parent) += C(n, k) Q_k(child) (z_parent - z_child)^(n - k)
+  //L_j(child) += C(k, j) L_k(parent) (z_child - z_parent)^(k - j)
+  //L_k(target) -= C(n + k, n) Q_n(source) D_(n + k)(z_target - z_source), D the Taylor coefficients of 1 / r
+  //Each table is grouped by output term, see Translate().
+  m2m.clear();
+  l2l.clear();
+  m2l.clear();
+  for (int i = 0; i < terms; i++)
+  {
+    for (int j = 0; j < terms; j++)
+    {
+      if (ex[j] <= ex[i] && ey[j] <= ey[i] && ez[j] <= ez[i])
+      {
+        Shift up = {i, j, Term(ex[i] - ex[j], ey[i] - ey[j], ez[i] - ez[j]),
+                    Binomial(ex[i], ex[j]) * Binomial(ey[i], ey[j]) * Binomial(ez[i], ez[j])};
+        m2m.push_back(up);
+      }
+      if (ex[i] <= ex[j] && ey[i] <= ey[j] && ez[i] <= ez[j])
+      {
+        Shift down = {i, j, Term(ex[j] - ex[i], ey[j] - ey[i], ez[j] - ez[i]),
+                      Binomial(ex[j], ex[i]) * Binomial(ey[j], ey[i]) * Binomial(ez[j], ez[i])};
+        l2l.push_back(down);
+      }
+      if (degree[i] + degree[j] <= order)
+      {
+        Shift far = {i, j, Term(ex[i] + ex[j], ey[i] + ey[j], ez[i] + ez[j]),
+                     -Binomial(ex[i] + ex[j], ex[j]) * Binomial(ey[i] + ey[j], ey[j]) * Binomial(ez[i] + ez[j], ez[j])};
+        m2l.push_back(far);
+      }
+    }
+  }
+}
+
+//out[to] += sum coef * in[from] * pw[power] over a table; the sum for one output term stays in a register
+static void Translate(const std::vector<Fmm::Shift> &table, const double *in, const double *pw, double *out)
+{
+  const Fmm::Shift *s = table.data(), *end = s + table.size();
+  while (s != end)
+  {
+    int to = s->to;
+    double sum = 0;
+    for (; s != end && s->to == to; s++)
+      sum += s->coef * in[s->from] * pw[s->power];
+    out[to] += sum;
+  }
+}
+
+//pw[t] = x^ex[t] y^ey[t] z^ez[t]
+void Fmm::Powers(double x, double y, double z, double *pw) const
+{
+  double v[3] = {x, y, z};
+  pw[0] = 1;
+  for (int t = 1; t < terms; t++)
+    pw[t] = pw[prevTerm[t]] * v[prevAxis[t]];
+}
+
+//d[t] = D^n (1 / |R|) / n! at R = (x, y, z), from the recurrence
+//|R|^2 d_n = -((2m - 1) / m) sum_i R_i d_(n - e_i) - ((m - 1) / m) sum_i d_(n - 2 e_i), m = |n|
+void Fmm::Derivatives(double x, double y, double z, double *d) const
+{
+  const int *lx = lower[0].data(), *ly = lower[1].data(), *lz = lower[2].data();
+  const int *lx2 = lower2[0].data(), *ly2 = lower2[1].data(), *lz2 = lower2[2].data();
+  double inv2 = 1 / (x * x + y * y + z * z);
+  d[terms] = 0;
+  d[0] = sqrt(inv2);
+  for (int t = 1; t < terms; t++)
+  {
+    double s1 = x * d[lx[t]] + y * d[ly[t]] + z * d[lz[t]];
+    double s2 = d[lx2[t]] + d[ly2[t]] + d[lz2[t]];
+    d[t] = -(first[t] * s1 + second[t] * s2) * inv2;
+  }
+}
+
+//Center, radius and multipole of cell c from its bodies or its children
+void Fmm::Upward(int c)
+{
+  const OctreeNode &node = tree.Nodes()[c];
+  Cell &cell = cells[c];
+  if (node.mass > 0)
+  {
+    cell.x = node.mx / node.mass;
+    cell.y = node.my / node.mass;
+    cell.z = node.mz / node.mass;
+  }
+  else
+  {
+    cell.x = node.cx;
+    cell.y = node.cy;
+    cell.z = node.cz;
+  }
+  double *q = &multipole[(size_t)c * terms];
+  std::fill(q, q + terms, 0.0);
+  double pw[MaxTerms];
+  if (node.leaf)
+  {
+    double r2 = 0;
+    for (int k = node.begin; k < node.end; k++)
+    {
+      double dx = cell.x - sx[k];
+      double dy = cell.y - sy[k];
+      double dz = cell.z - sz[k];
+      r2 = std::max(r2, dx * dx + dy * dy + dz * dz);
+      Powers(dx, dy, dz, pw);
+      for (int t = 0; t < terms; t++)
+        q[t] += sm[k] * pw[t];
+    }
+    cell.r = sqrt(r2);
+    return;
+  }
+
+  double reach = 0;
+  for (int k = 0; k < 8; k++)
+  {
+    int child = node.child[k];
+    if (child == -1)
+      continue;
+    const Cell &sub = cells[child];
+    double dx = cell.x - sub.x;
+    double dy = cell.y - sub.y;
+    double dz = cell.z - sub.z;
+    reach = std::max(reach, sqrt(dx * dx + dy * dy + dz * dz) + sub.r);
+    Powers(dx, dy, dz, pw);
+    Translate(m2m, &multipole[(size_t)child * terms], pw, q);
+  }
+  //The farthest corner of the cube bounds the radius as well
+  double cx = fabs(cell.x - node.cx) + node.half;
+  double cy = fabs(cell.y - node.cy) + node.half;
+  double cz = fabs(cell.z - node.cz) + node.half;
+  cell.r = std::min(reach, sqrt(cx * cx + cy * cy + cz * cz));
+}
+
+bool Fmm::Separated(int a, int b) const
+{
+  const Cell &ca = cells[a], &cb = cells[b];
+  double dx = ca.x - cb.x;
+  double dy = ca.y - cb.y;
+  double dz = ca.z - cb.z;
+  double reach = ca.r + cb.r;
+  return reach * reach < theta * theta * (dx * dx + dy * dy + dz * dz);
+}
+
+void Fmm::M2L(int b, int a, double *d)
+{
+  const Cell &ca = cells[a], &cb = cells[b];
+  Derivatives(cb.x - ca.x, cb.y - ca.y, cb.z - ca.z, d);
+  Translate(m2l, &multipole[(size_t)a * terms], d, &local[(size_t)b * terms]);
+}
+
+void Fmm::L2L(int b, int c, double *pw)
+{
+  const Cell &cb = cells[b], &cc = cells[c];
+  Powers(cc.x - cb.x, cc.y - cb.y, cc.z - cb.z, pw);
+  Translate(l2l, &local[(size_t)b * terms], pw, &local[(size_t)c * terms]);
+}
+
+//Direct sums from the bodies of leaf a onto those of leaf b, without G. Only b's task writes b's range.
+void Fmm::P2P(int b, int a, bool potential)
+{
+  const OctreeNode &nb = tree.Nodes()[b], &na = tree.Nodes()[a];
+  PairwiseBlock(isa, ForceLaw(), nb.begin, nb.end, na.begin, na.end, sx.data(), sy.data(), sz.data(), sm.data(), 1.0,
+                ox.data(), oy.data(), oz.data(), potential ? op.data() : nullptr);
+  for (int i = nb.begin; i < nb.end; i++)
+  {
+    tx[i] += ox[i];
+    ty[i] += oy[i];
+    tz[i] += oz[i];
+    if (potential)
+      tp[i] += op[i];
+  }
+}
+
+//Adds the local expansion of leaf b to its near field sums and stores the result for each of its bodies
+void Fmm::L2P(int b, double G, double *ax, double *ay, double *az, double *phi, double *pw)
+{
+  const OctreeNode &node = tree.Nodes()[b];
+  const Cell &cell = cells[b];
+  const double *l = &local[(size_t)b * terms];
+  const std::vector<int> &index = tree.Index();
+  for (int k = node.begin; k < node.end; k++)
+  {
+    Powers(sx[k] - cell.x, sy[k] - cell.y, sz[k] - cell.z, pw);
+    double potential = 0, gx = 0, gy = 0, gz = 0;
+    for (int t = 0; t < terms; t++)
+    {
+      potential += l[t] * pw[t];
+      if (down[0][t] >= 0)
+        gx += ex[t] * l[t] * pw[down[0][t]];
+      if (down[1][t] >= 0)
+        gy += ey[t] * l[t] * pw[down[1][t]];
+      if (down[2][t] >= 0)
+        gz += ez[t] * l[t] * pw[down[2][t]];
+    }
+    int i = index[k];
+    ax[i] = G * (tx[k] - gx);
+    ay[i] = G * (ty[k] - gy);
+    az[i] = G * (tz[k] - gz);
+    if (phi != nullptr)
+      phi[i] = G * (potential + tp[k]);
+  }
+}
+
+//Downward pass below target cell b, whose candidate source cells are stack[from, end) on entry.
+//Sources far enough away go through M2L, the rest are passed on to the children, opening a source first when it is
+//larger than the child. A leaf target opens its near sources until they are far enough or leaves, which it sums
+//directly. With defer given, children at splitDepth are queued as tasks instead of being descended into.
+void Fmm::Target(int b, std::vector<int> &stack, size_t from, std::vector<Task> *defer,
+                 double G, double *ax, double *ay, double *az, double *phi)
+{
+  const std::vector<OctreeNode> &nodes = tree.Nodes();
+  const OctreeNode &node = nodes[b];
+  double scratch[MaxTerms];
+  if (node.leaf)
+  {
+    for (size_t k = from; k < stack.size(); k++)
+    {
+      int a = stack[k];
+      if (Separated(a, b))
+        M2L(b, a, scratch);
+      else if (nodes[a].leaf)
+        P2P(b, a, phi != nullptr);
+      else
+      {
+        for (int c = 0; c < 8; c++)
+        {
+          int child = nodes[a].child[c];
+          if (child != -1 && nodes[child].mass != 0)
+            stack.push_back(child);
+        }
+      }
+    }
+    stack.resize(from);
+    L2P(b, G, ax, ay, az, phi, scratch);
+    return;
+  }
+
+  size_t end = stack.size();
+  for (size_t k = from; k < end; k++)
+  {
+    int a = stack[k];
+    if (Separated(a, b))
+      M2L(b, a, scratch);
+    else
+      stack.push_back(a);
+  }
+  size_t nearEnd = stack.size();
+  for (int c = 0; c < 8; c++)
+  {
+    int child = node.child[c];
+    if (child == -1)
+      continue;
+    L2L(b, child, scratch);
+    size_t childFrom = stack.size();
+    for (size_t k = end; k < nearEnd; k++)
+    {
+      int a = stack[k];
+      if (nodes[a].leaf || cells[a].r <= cells[child].r)
+      {
+        stack.push_back(a);
+        continue;
+      }
+      for (int s = 0; s < 8; s++)
+      {
+        int sub = nodes[a].child[s];
+        if (sub != -1 && nodes[sub].mass != 0)
+          stack.push_back(sub);
+      }
+    }
+    if (defer != nullptr && cells[child].depth >= splitDepth)
+    {
+      Task task;
+      task.cell = child;
+      task.candidates.assign(stack.begin() + childFrom, stack.end());
+      defer->push_back(task);
+      stack.resize(childFrom);
+    }
+    else
+      Target(child, stack, childFrom, defer, G, ax, ay, az, phi);
+  }
+  stack.resize(from);
+}
+
+void Fmm::Accelerations(const Bodies &bodies, double G, ThreadPool *pool, double *ax, double *ay, double *az, double *phi)
+{
+  order = std::max(1, std::min(order, (int)MaxOrder));
+  if (order != tableOrder)
+    Tables();
+  int n = bodies.size();
+  if (n == 0)
+    return;
+  tree.Build(bodies);
+  const std::vector<OctreeNode> &nodes = tree.Nodes();
+  const std::vector<int> &index = tree.Index();
+  int count = nodes.size();
+  cells.resize(count);
+  multipole.resize((size_t)count * terms);
+  local.assign((size_t)count * terms, 0.0);
+
+  //Parents come before their children, so one forward sweep gives every depth
+  levels.clear();
+  cells[0].depth = 0;
+  for (int c = 0; c < count; c++)
+  {
+    int depth = cells[c].depth;
+    if ((int)levels.size() <= depth)
+      levels.resize(depth + 1);
+    levels[depth].push_back(c);
+    for (int k = 0; k < 8; k++)
+    {
+      if (nodes[c].child[k] != -1)
+        cells[nodes[c].child[k]].depth = depth + 1;
+    }
+  }
+
+  sx.resize(n);
+  sy.resize(n);
+  sz.resize(n);
+  sm.resize(n);
+  tx.assign(n, 0.0);
+  ty.assign(n, 0.0);
+  tz.assign(n, 0.0);
+  tp.assign(n, 0.0);
+  ox.resize(n);
+  oy.resize(n);
+  oz.resize(n);
+  op.resize(n);
+  ThreadPool::Task gather = [&](int begin, int end, int) {
+    for (int k = begin; k < end; k++)
+    {
+      int i = index[k];
+      sx[k] = bodies.x[i];
+      sy[k] = bodies.y[i];
+      sz[k] = bodies.z[i];
+      sm[k] = bodies.mass[i];
+    }
+  };
+  if (pool)
+    pool->ParallelFor(n, 4096, gather);
+  else
+    gather(0, n, 0);
+
+  //Upward pass one level at a time, deepest first; the cells of a level are independent
+  for (int depth = levels.size() - 1; depth >= 0; depth--)
+  {
+    const std::vector<int> &level = levels[depth];
+    ThreadPool::Task up = [&](int begin, int end, int) {
+      for (int k = begin; k < end; k++)
+        Upward(level[k]);
+    };
+    if (pool)
+      pool->ParallelFor(level.size(), 16, up);
+    else
+      up(0, level.size(), 0);
+  }
+
+  //Downward pass: the top of the tree serially, then the subtrees below splitDepth in parallel.
+  //Every cell sees the same sources in the same order either way, so results do not depend on the thread count.
+  int workers = pool ? pool->Size() : 1;
+  splitDepth = 1;
+  while (splitDepth + 1 < (int)levels.size() && (int)levels[splitDepth].size() < 16 * workers)
+    splitDepth++;
+  stacks.resize(workers);
+  tasks.clear();
+  stacks[0].clear();
+  if (nodes[0].mass != 0)
+    stacks[0].push_back(0);
+  Target(0, stacks[0], 0, &tasks, G, ax, ay, az, phi);
+  ThreadPool::Task descend = [&](int begin, int end, int worker) {
+    std::vector<int> &stack = stacks[worker];
+    for (int k = begin; k < end; k++)
+    {
+      stack.assign(tasks[k].candidates.begin(), tasks[k].candidates.end());
+      Target(tasks[k].cell, stack, 0, nullptr, G, ax, ay, az, phi);
+    }
+  };
+  if (pool)
+    pool->ParallelFor(tasks.size(), 1, descend);
+  else
+    descend(0, tasks.size(), 0);
+}
@@ -0,0 +1,87 @@
+#ifndef _FMM_H_
+#define _FMM_H_
+
+#include "Bodies.h"
+#include "Kernel.h"
+#include "Octree.h"
+#include "ThreadPool.h"
+#include <vector>
+
+//Cartesian fast multipole solver for Newtonian gravity.
+//Cells of an octree carry multipoles Q_n = sum m (z - x)^n about their center of mass and local Taylor
+//expansions of the potential, both up to total degree order in the multi-index n. Multipoles go up the tree (P2M,
+//M2M), every target cell takes the far cells through M2L, passes its expansion down (L2L) and evaluates it at its
+//bodies (L2P); near leaf pairs are summed directly. For a fixed order and theta the cost is O(N).
+class Fmm
+{
+public:
+  static const int MaxOrder = 10;
+  int order;    //Expansion degree, 1 (monopole forces) to MaxOrder
+  double theta; //Two cells interact through expansions when (r_a + r_b) < theta * distance
+  KernelIsa isa; //Kernel for the near field
+
+  //One term of a translation: out[to] += coef * in[from] * power[power]
+  struct Shift
+  {
+    int to, from, power;
+    double coef;
+  };
+
+  Fmm();
+
+  //a_i = G * sum_j m_j * r_ij / |r_ij|^3 for every body, and phi_i = -G * sum_j m_j / |r_ij| when phi is given
+  void Accelerations(const Bodies &bodies, double G, ThreadPool *pool, double *ax, double *ay, double *az, double *phi);
+
+  size_t CellCount() const { return tree.NodeCount(); }
+
+private:
+  struct Cell
+  {
+    double x, y, z; //Expansion center
+    double r;       //Radius around the center that holds every body of the cell
+    int depth;
+  };
+  //Deferred subtree of the downward pass, with the source cells its root still has to look at
+  struct Task
+  {
+    int cell;
+    std::vector<int> candidates;
+  };
+
+  Octree tree;
+  std::vector<Cell> cells;
+  std::vector<std::vector<int>> levels; //Cell ids by depth
+  std::vector<double> multipole, local; //terms values per cell
+  AlignedDoubles sx, sy, sz, sm;        //Bodies in tree order
+  AlignedDoubles tx, ty, tz, tp;        //Near field sums in tree order
+  AlignedDoubles ox, oy, oz, op;        //Output of one leaf pair
+  std::vector<std::vector<int>> stacks; //Candidate lists per worker
+  std::vector<Task> tasks;
+  int splitDepth;
+
+  //Multi-index tables for the current order
+  int tableOrder;
+  int terms;
+  std::vector<int> ex, ey, ez, degree;
+  std::vector<int> down[3], down2[3]; //Term with one or two less in each axis, -1 if none
+  std::vector<int> lower[3], lower2[3]; //The same with terms standing in for none, a slot that is kept at zero
+  std::vector<double> first, second;    //Recurrence weights (2m - 1) / m and (m - 1) / m
+  std::vector<int> prevTerm, prevAxis; //Power recurrence: x^n = x^prev * x_axis
+  std::vector<Shift> m2m, m2l, l2l;
+
+  void Tables();
+  int Term(int nx, int ny, int nz) const;
+  void Powers(double x, double y, double z, double *pw) const;
+  void Derivatives(double x, double y, double z, double *d) const; //d holds terms + 1 values
+
+  void Upward(int c);
+  bool Separated(int a, int b) const;
+  void M2L(int b, int a, double *d);
+  void L2L(int b, int c, double *pw);
+  void P2P(int b, int a, bool potential);
+  void L2P(int b, double G, double *ax, double *ay, double *az, double *phi, double *pw);
+  void Target(int b, std::vector<int> &stack, size_t from, std::vector<Task> *defer,
+              double G, double *ax, double *ay, double *az, double *phi);
+};
+
+#endif
@@ -0,0 +1,148 @@
+#ifndef _FORCELAW_H_
+#define _FORCELAW_H_
+
+#include <cmath>
+#include <string>
+
+enum ForceLawKind
+{
+  LAW_NEWTON,
+  LAW_PLUMMER,
+  LAW_SPLINE,
+  LAW_YUKAWA
+};
+
+//Runtime choice of pair interaction. The kernels switch on kind once per call and run a loop compiled for that law.
+struct ForceLaw
+{
+  ForceLawKind kind;
+  double softening; //Plummer equivalent length; the spline kernel reaches zero force at 2.8 times this
+  double alpha;     //Yukawa strength relative to gravity
+  double lambda;    //Yukawa range
+
+  ForceLaw() : kind(LAW_NEWTON), softening(0), alpha(0), lambda(1) {}
+};
+
+bool ParseForceLaw(const std::string &name, ForceLawKind &kind);
+const char *ForceLawName(ForceLawKind kind);
+
+//Each law gives, for a pair at squared separation r2 > 0, the factor f with a = G m f r_ij and the factor p with
+//phi = -G m p. Slope is df/dr2, which the Hermite integrator needs for the jerk.
+//The vector kernels only know how to compute 1 / sqrt(r2 + Offset()); a law that is exactly that everywhere
+//sets softened, and one that differs from it below r2 < Patch() sets patched so those lanes are redone with Force.
+//Laws that are not vectorized run the scalar loop on every ISA.
+template <typename T>
+struct NewtonLaw
+{
+  static const bool vectorized = true, softened = false, patched = false;
+
+  explicit NewtonLaw(const ForceLaw &) {}
+  T Offset() const { return 0; }
+  T Patch() const { return 0; }
+
+  T Force(T r2, T &p) const
+  {
+    T inv = 1 / std::sqrt(r2);
+    p = inv;
+    return inv * (inv * inv);
+  }
+  T Slope(T r2, T f) const { return T(-1.5) * f / r2; }
+};
+
+//Plummer sphere softening: 1 / (r^2 + eps^2)^(3/2) everywhere
+template <typename T>
+struct PlummerLaw
+{
+  static const bool vectorized = true, softened = true, patched = false;
+  T eps2;
+
+  explicit PlummerLaw(const ForceLaw &law) : eps2(T(law.softening * law.softening)) {}
+  T Offset() const { return eps2; }
+  T Patch() const { return 0; }
+
+  T Force(T r2, T &p) const
+  {
+    T s = r2 + eps2;
+    T inv = 1 / std::sqrt(s);
+    p = inv;
+    return inv * (inv * inv);
+  }
+  T Slope(T r2, T f) const { return T(-1.5) * f / (r2 + eps2); }
+};
+
+//Cubic spline kernel softening (Monaghan and Lattanzio, as in GADGET): exactly Newtonian beyond h = 2.8 eps,
+//smooth and finite inside, so close pairs are bounded without biasing the far field like Plummer does
+template <typename T>
+struct SplineLaw
+{
+  static const bool vectorized = true, softened = false, patched = true;
+  T h, h2, hinv, hinv3;
+
+  explicit SplineLaw(const ForceLaw &law)
+    : h(T(2.8 * law.softening)), h2(h * h), hinv(h > 0 ? 1 / h : 0), hinv3(hinv * hinv * hinv) {}
+  T Offset() const { return 0; }
+  T Patch() const { return h2; }
+
+  T Force(T r2, T &p) const
+  {
+    if (r2 >= h2)
+    {
+      T inv = 1 / std::sqrt(r2);
+      p = inv;
+      return inv * (inv * inv);
+    }
+    T u = std::sqrt(r2) * hinv;
+    T u2 = u * u;
+    if (u < T(0.5))
+    {
+      p = -hinv * (T(-2.8) + u2 * (T(16.0 / 3) + u2 * (T(6.4) * u - T(9.6))));
+      return hinv3 * (T(32.0 / 3) + u2 * (T(32) * u - T(38.4)));
+    }
+    p = -hinv * (T(-3.2) + T(1.0 / 15) / u + u2 * (T(32.0 / 3) + u * (T(-16) + u * (T(9.6) - T(32.0 / 15) * u))));
+    return hinv3 * (T(64.0 / 3) - T(48) * u + T(38.4) * u2 - T(32.0 / 3) * u2 * u - T(1.0 / 15) / (u2 * u));
+  }
+  T Slope(T r2, T f) const
+  {
+    if (r2 >= h2)
+      return T(-1.5) * f / r2;
+    T u = std::sqrt(r2) * hinv;
+    //df/dr2 = df/du / (2 u h^2)
+    if (u < T(0.5))
+      return hinv3 * hinv * hinv * (T(48) * u - T(38.4));
+    T u2 = u * u;
+    return hinv3 * (T(-48) + T(76.8) * u - T(32) * u2 + T(0.2) / (u2 * u2)) / (2 * u * h2);
+  }
+};
+
+//Newtonian gravity plus a Yukawa term, phi = -G m (1 + alpha e^(-r/lambda)) / r, Plummer softened through
+//r^2 -> r^2 + eps^2. The exponential keeps it out of the vector kernels.
+template <typename T>
+struct YukawaLaw
+{
+  static const bool vectorized = false, softened = true, patched = false;
+  T eps2, alpha, kappa;
+
+  explicit YukawaLaw(const ForceLaw &law)
+    : eps2(T(law.softening * law.softening)), alpha(T(law.alpha)), kappa(law.lambda > 0 ? T(1 / law.lambda) : 0) {}
+  T Offset() const { return eps2; }
+  T Patch() const { return 0; }
+
+  T Force(T r2, T &p) const
+  {
+    T s = r2 + eps2;
+    T inv = 1 / std::sqrt(s);
+    T r = s * inv;
+    T e = alpha * std::exp(-kappa * r);
+    p = (1 + e) * inv;
+    return (1 + e * (1 + kappa * r)) * inv * (inv * inv);
+  }
+  T Slope(T r2, T f) const
+  {
+    T s = r2 + eps2;
+    T inv = 1 / std::sqrt(s);
+    T e = alpha * std::exp(-kappa * s * inv);
+    return T(-0.5) * (e * kappa * kappa * inv + 3 * f) / s;
+  }
+};
+
+#endif
@@ -0,0 +1,160 @@
+#include "FrameEncoder.h"
+#include "./Dependencies/include/SDL2/SDL.h"
+#include "./Dependencies/include/SDL2/SDL_image.h"
+#include <algorithm>
+#include <cstdio>
+
+bool ParseFrameFormat(const std::string &name, FrameFormat &format)
+{
+  if (name == "png")
+    format = FRAME_PNG;
+  else if (name == "ppm")
+    format = FRAME_PPM;
+  else if (name == "raw")
+    format = FRAME_RAW;
+  else
+    return false;
+  return true;
+}
+
+const char *FrameExtension(FrameFormat format)
+{
+  switch (format)
+  {
+  case FRAME_PPM:
+    return "ppm";
+  case FRAME_RAW:
+    return "raw";
+  default:
+    return "png";
+  }
+}
+
+FrameEncoder::FrameEncoder() : format(FRAME_PNG), stopping(false), encoded(0), failed(0)
+{
+}
+
+FrameEncoder::~FrameEncoder()
+{
+  Finish();
+}
+
+void FrameEncoder::Start(int workers, size_t queueDepth)
+{
+  Finish();
+  if (format == FRAME_PNG)
+    IMG_Init(IMG_INIT_PNG); //Load the PNG backend once here rather than racing in the workers
+  stopping = false;
+  encoded = 0;
+  failed = 0;
+  workers = std::max(workers, 1);
+  //Every worker can hold one buffer while the queue holds the rest
+  for (size_t i = 0; i < queueDepth + workers; i++)
+    spare.push_back(new Job());
+  for (int i = 0; i < workers; i++)
+    threads.push_back(std::thread(&FrameEncoder::Loop, this));
+}
+
+void FrameEncoder::Submit(const std::string &path, const uint32_t *pixels, int width, int height)
+{
+  Job *job;
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    space.wait(guard, [this] { return !spare.empty(); });
+    job = spare.back();
+    spare.pop_back();
+  }
+  job->path = path;
+  job->pixels.assign(pixels, pixels + static_cast<size_t>(width) * height);
+  job->width = width;
+  job->height = height;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    queue.push_back(job);
+  }
+  wake.notify_one();
+}
+
+void FrameEncoder::Finish()
+{
+  if (threads.empty())
+    return;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (size_t i = 0; i < threads.size(); i++)
+    threads[i].join();
+  threads.clear();
+  for (size_t i = 0; i < spare.size(); i++)
+    delete spare[i];
+  spare.clear();
+  if (failed > 0)
+    printf("%ld frames could not be written\n", failed);
+}
+
+void FrameEncoder::Loop()
+{
+  while (true)
+  {
+    Job *job;
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      wake.wait(guard, [this] { return stopping || !queue.empty(); });
+      if (queue.empty())
+        return;
+      job = queue.front();
+      queue.pop_front();
+    }
+    bool ok = Encode(*job);
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      if (ok)
+        encoded++;
+      else
+        failed++;
+      spare.push_back(job);
+    }
+    space.notify_one();
+  }
+}
+
+bool FrameEncoder::Encode(const Job &job)
+{
+  if (format == FRAME_PNG)
+  {
+    SDL_Surface *surface = SDL_CreateRGBSurfaceFrom(const_cast<uint32_t *>(job.pixels.data()), job.width, job.height, 32,
+                                                    job.width * 4, 0x00FF0000, 0x0000FF00, 0x000000FF, 0);
+    if (surface == nullptr)
+      return false;
+    bool ok = IMG_SavePNG(surface, job.path.c_str()) == 0;
+    SDL_FreeSurface(surface);
+    return ok;
+  }
+
+  FILE *file = fopen(job.path.c_str(), "wb");
+  if (file == nullptr)
+    return false;
+  bool ok;
+  if (format == FRAME_RAW)
+    ok = fwrite(job.pixels.data(), 4, job.pixels.size(), file) == job.pixels.size();
+  else
+  {
+    fprintf(file, "P6\n%d %d\n255\n", job.width, job.height);
+    std::vector<unsigned char> row(job.width * 3);
+    ok = true;
+    for (int y = 0; y < job.height && ok; y++)
+    {
+      const uint32_t *p = &job.pixels[static_cast<size_t>(y) * job.width];
+      for (int x = 0; x < job.width; x++)
+      {
+        row[x * 3] = (p[x] >> 16) & 0xFF;
+        row[x * 3 + 1] = (p[x] >> 8) & 0xFF;
+        row[x * 3 + 2] = p[x] & 0xFF;
+      }
+      ok = fwrite(row.data(), 1, row.size(), file) == row.size();
+    }
+  }
+  return fclose(file) == 0 && ok;
+}
@@ -0,0 +1,63 @@
+#ifndef _FRAMEENCODER_H_
+#define _FRAMEENCODER_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum FrameFormat
+{
+  FRAME_PNG, //Via SDL_image
+  FRAME_PPM, //Binary P6
+  FRAME_RAW  //The framebuffer bytes as is, B G R A per pixel, for ffmpeg -f rawvideo -pix_fmt bgra
+};
+
+bool ParseFrameFormat(const std::string &name, FrameFormat &format);
+const char *FrameExtension(FrameFormat format);
+
+//Pool of threads writing rendered frames to image files, so encoding overlaps with stepping
+class FrameEncoder
+{
+public:
+  FrameFormat format;
+
+  FrameEncoder();
+  ~FrameEncoder();
+
+  void Start(int workers, size_t queueDepth);
+  //Copies 0xAARRGGBB pixels and queues them for path. Blocks only while every buffer waits on an encoder,
+  //since a movie with missing frames is worse than a slower run
+  void Submit(const std::string &path, const uint32_t *pixels, int width, int height);
+  //Waits until every queued frame is written and stops the workers
+  void Finish();
+
+  long Encoded() const { return encoded; }
+  long Failed() const { return failed; }
+
+private:
+  struct Job
+  {
+    std::string path;
+    std::vector<uint32_t> pixels;
+    int width, height;
+  };
+
+  std::vector<std::thread> threads;
+  std::mutex lock;
+  std::condition_variable wake;
+  std::condition_variable space;
+  std::deque<Job *> queue;
+  std::vector<Job *> spare;
+  bool stopping;
+  long encoded;
+  long failed;
+
+  void Loop();
+  bool Encode(const Job &job);
+};
+
+#endif
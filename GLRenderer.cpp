@@ -0,0 +1,348 @@
+#include "GLRenderer.h"
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+#include <cstring>
+
+static const char *BODY_VERTEX =
+    "#version 330 core\n"
+    "layout(location = 0) in vec2 corner;\n"
+    "layout(location = 1) in vec3 body;\n" //Screen x, y and radius in pixels
+    "uniform vec2 screen;\n"
+    "out vec2 local;\n"
+    "flat out float radius;\n"
+    "void main()\n"
+    "{\n"
+    "  radius = body.z;\n"
+    "  local = corner * (body.z + 1.0);\n" //One pixel of margin for the anti-aliased edge
+    "  vec2 p = body.xy + local;\n"
+    "  gl_Position = vec4(p.x / screen.x * 2.0 - 1.0, 1.0 - p.y / screen.y * 2.0, 0.0, 1.0);\n"
+    "}\n";
+
+static const char *BODY_FRAGMENT =
+    "#version 330 core\n"
+    "in vec2 local;\n"
+    "flat in float radius;\n"
+    "out vec4 color;\n"
+    "void main()\n"
+    "{\n"
+    "  float d = length(local);\n"
+    "  float alpha = clamp(radius + 0.5 - d, 0.0, 1.0);\n"
+    "  if (alpha <= 0.0)\n"
+    "    discard;\n"
+    "  float nz = sqrt(max(1.0 - (d * d) / (radius * radius), 0.0));\n"
+    "  color = vec4(vec3(0.55 + 0.45 * nz), alpha);\n"
+    "}\n";
+
+static const char *LINE_VERTEX =
+    "#version 330 core\n"
+    "layout(location = 0) in vec2 point;\n"
+    "uniform vec2 screen;\n"
+    "void main()\n"
+    "{\n"
+    "  gl_Position = vec4((point.x + 0.5) / screen.x * 2.0 - 1.0, 1.0 - (point.y + 0.5) / screen.y * 2.0, 0.0, 1.0);\n"
+    "}\n";
+
+static const char *LINE_FRAGMENT =
+    "#version 330 core\n"
+    "out vec4 color;\n"
+    "void main()\n"
+    "{\n"
+    "  color = vec4(1.0);\n"
+    "}\n";
+
+static GLuint CompileShader(GLenum type, const char *source)
+{
+  GLuint shader = glCreateShader(type);
+  glShaderSource(shader, 1, &source, nullptr);
+  glCompileShader(shader);
+  GLint ok = GL_FALSE;
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+  if (!ok)
+  {
+    char log[1024];
+    glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+    printf("Shader compile failed: %s\n", log);
+    glDeleteShader(shader);
+    return 0;
+  }
+  return shader;
+}
+
+static GLuint LinkProgram(const char *vertex, const char *fragment)
+{
+  GLuint vs = CompileShader(GL_VERTEX_SHADER, vertex);
+  GLuint fs = CompileShader(GL_FRAGMENT_SHADER, fragment);
+  if (vs == 0 || fs == 0)
+  {
+    glDeleteShader(vs);
+    glDeleteShader(fs);
+    return 0;
+  }
+  GLuint program = glCreateProgram();
+  glAttachShader(program, vs);
+  glAttachShader(program, fs);
+  glLinkProgram(program);
+  glDeleteShader(vs);
+  glDeleteShader(fs);
+  GLint ok = GL_FALSE;
+  glGetProgramiv(program, GL_LINK_STATUS, &ok);
+  if (!ok)
+  {
+    char log[1024];
+    glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+    printf("Shader link failed: %s\n", log);
+    glDeleteProgram(program);
+    return 0;
+  }
+  return program;
+}
+
+StreamBuffer::StreamBuffer() : buffer(0), persistent(false), regionBytes(0), region(0), used(0), mapped(nullptr)
+{
+  for (int r = 0; r < REGIONS; r++)
+    fences[r] = 0;
+}
+
+bool StreamBuffer::Create(size_t bytes, bool usePersistent)
+{
+  Destroy();
+  persistent = usePersistent;
+  regionBytes = bytes;
+  region = 0;
+  glGenBuffers(1, &buffer);
+  glBindBuffer(GL_ARRAY_BUFFER, buffer);
+  if (persistent)
+  {
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(GL_ARRAY_BUFFER, regionBytes * REGIONS, nullptr, flags);
+    mapped = static_cast<unsigned char *>(glMapBufferRange(GL_ARRAY_BUFFER, 0, regionBytes * REGIONS, flags));
+    if (mapped == nullptr)
+    {
+      //Some drivers advertise the extension but refuse the mapping; fall back to plain uploads
+      glDeleteBuffers(1, &buffer);
+      buffer = 0;
+      return Create(bytes, false);
+    }
+  }
+  else
+    glBufferData(GL_ARRAY_BUFFER, regionBytes, nullptr, GL_STREAM_DRAW);
+  return true;
+}
+
+void StreamBuffer::Destroy()
+{
+  if (buffer == 0)
+    return;
+  for (int r = 0; r < REGIONS; r++)
+    Wait(r);
+  if (mapped != nullptr)
+  {
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+    mapped = nullptr;
+  }
+  glDeleteBuffers(1, &buffer);
+  buffer = 0;
+}
+
+void StreamBuffer::Wait(int r)
+{
+  if (fences[r] == 0)
+    return;
+  while (glClientWaitSync(fences[r], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED)
+  {
+  }
+  glDeleteSync(fences[r]);
+  fences[r] = 0;
+}
+
+void *StreamBuffer::Begin(size_t bytes)
+{
+  used = bytes;
+  if (!persistent)
+  {
+    staging.resize(bytes);
+    return staging.data();
+  }
+  if (bytes > regionBytes)
+    Create(std::max(bytes, regionBytes * 2), true);
+  if (!persistent)
+    return Begin(bytes);
+  region = (region + 1) % REGIONS;
+  //Only blocks if the GPU is still reading the frame from three frames ago
+  Wait(region);
+  return mapped + region * regionBytes;
+}
+
+GLintptr StreamBuffer::Commit()
+{
+  glBindBuffer(GL_ARRAY_BUFFER, buffer);
+  if (persistent)
+    return region * regionBytes;
+  if (used > regionBytes)
+    regionBytes = std::max(used, regionBytes * 2);
+  //Orphan the old storage so the driver never has to wait for the previous frame's draws
+  glBufferData(GL_ARRAY_BUFFER, regionBytes, nullptr, GL_STREAM_DRAW);
+  glBufferSubData(GL_ARRAY_BUFFER, 0, used, staging.data());
+  return 0;
+}
+
+void StreamBuffer::Fence()
+{
+  if (persistent)
+    fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+GLRenderer::GLRenderer() : bodyProgram(0), lineProgram(0), bodyScreen(-1), lineScreen(-1), bodyVao(0), lineVao(0), quad(0), ready(false)
+{
+}
+
+GLRenderer::~GLRenderer()
+{
+  Shutdown();
+}
+
+bool GLRenderer::Init()
+{
+  glewExperimental = GL_TRUE;
+  if (glewInit() != GLEW_OK)
+  {
+    printf("Could not initialise GLEW\n");
+    return false;
+  }
+  //glewInit can leave a harmless GL_INVALID_ENUM behind on core profiles
+  glGetError();
+  if (!GLEW_VERSION_3_3)
+  {
+    printf("The GL renderer needs OpenGL 3.3, the context only offers %s\n", glGetString(GL_VERSION));
+    return false;
+  }
+
+  bodyProgram = LinkProgram(BODY_VERTEX, BODY_FRAGMENT);
+  lineProgram = LinkProgram(LINE_VERTEX, LINE_FRAGMENT);
+  if (bodyProgram == 0 || lineProgram == 0)
+  {
+    Shutdown();
+    return false;
+  }
+  bodyScreen = glGetUniformLocation(bodyProgram, "screen");
+  lineScreen = glGetUniformLocation(lineProgram, "screen");
+
+  bool persistent = GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+  stream.Create(1 << 20, persistent);
+
+  const float corners[8] = {-1, -1, 1, -1, -1, 1, 1, 1};
+  glGenBuffers(1, &quad);
+  glBindBuffer(GL_ARRAY_BUFFER, quad);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+
+  glGenVertexArrays(1, &bodyVao);
+  glBindVertexArray(bodyVao);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+  glEnableVertexAttribArray(1);
+  glVertexAttribDivisor(1, 1);
+
+  glGenVertexArrays(1, &lineVao);
+  glBindVertexArray(lineVao);
+  glEnableVertexAttribArray(0);
+  glBindVertexArray(0);
+
+  printf("GL renderer on %s, %s uploads\n", glGetString(GL_RENDERER), stream.Persistent() ? "persistent mapped" : "orphaned");
+  ready = true;
+  return true;
+}
+
+void GLRenderer::Shutdown()
+{
+  if (bodyProgram == 0 && lineProgram == 0 && quad == 0)
+    return;
+  stream.Destroy();
+  glDeleteBuffers(1, &quad);
+  glDeleteVertexArrays(1, &bodyVao);
+  glDeleteVertexArrays(1, &lineVao);
+  glDeleteProgram(bodyProgram);
+  glDeleteProgram(lineProgram);
+  quad = bodyVao = lineVao = bodyProgram = lineProgram = 0;
+  ready = false;
+}
+
+void GLRenderer::Draw(int width, int height, const ScreenPoints &bodies, const double *mass, double pixelsPerMass,
+                      const std::vector<int> &visible, const ScreenPoints &trail, const std::vector<int> &trailStarts, int follow)
+{
+  glViewport(0, 0, width, height);
+  glClearColor(0, 0, 0, 1);
+  glClear(GL_COLOR_BUFFER_BIT);
+  if (!ready)
+    return;
+
+  size_t n = visible.size();
+  size_t points = trail.size();
+  bool box = follow >= 0 && follow < static_cast<int>(bodies.size());
+  //Layout of this frame's region: trail points, the follow box outline, then one instance per body
+  size_t lineFloats = (points + (box ? 5 : 0)) * 2;
+  float *data = static_cast<float *>(stream.Begin((lineFloats + n * 3) * sizeof(float)));
+  float *line = data;
+  for (size_t i = 0; i < points; i++)
+  {
+    line[i * 2] = static_cast<float>(trail.x[i]);
+    line[i * 2 + 1] = static_cast<float>(trail.y[i]);
+  }
+  if (box)
+  {
+    float half = static_cast<float>(ceil((ceil(mass[follow] * pixelsPerMass) + 1) / 2 * 1.25) + 1);
+    float cx = static_cast<float>(bodies.x[follow]), cy = static_cast<float>(bodies.y[follow]);
+    const float corners[10] = {-1, -1, 1, -1, 1, 1, -1, 1, -1, -1};
+    float *p = line + points * 2;
+    for (int k = 0; k < 5; k++)
+    {
+      p[k * 2] = cx + corners[k * 2] * half;
+      p[k * 2 + 1] = cy + corners[k * 2 + 1] * half;
+    }
+  }
+  float *inst = data + lineFloats;
+  for (size_t k = 0; k < n; k++)
+  {
+    int i = visible[k];
+    inst[k * 3] = static_cast<float>(bodies.x[i]);
+    inst[k * 3 + 1] = static_cast<float>(bodies.y[i]);
+    inst[k * 3 + 2] = static_cast<float>((ceil(mass[i] * pixelsPerMass) + 1) / 2);
+  }
+  GLintptr base = stream.Commit();
+
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+  firsts.clear();
+  counts.clear();
+  for (size_t k = 0; k + 1 < trailStarts.size(); k++)
+  {
+    firsts.push_back(trailStarts[k]);
+    counts.push_back(trailStarts[k + 1] - trailStarts[k]);
+  }
+  if (box)
+  {
+    firsts.push_back(static_cast<GLint>(points));
+    counts.push_back(5);
+  }
+  if (!firsts.empty())
+  {
+    glUseProgram(lineProgram);
+    glUniform2f(lineScreen, static_cast<float>(width), static_cast<float>(height));
+    glBindVertexArray(lineVao);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, reinterpret_cast<const void *>(base));
+    glMultiDrawArrays(GL_LINE_STRIP, firsts.data(), counts.data(), static_cast<GLsizei>(firsts.size()));
+  }
+
+  if (n > 0)
+  {
+    glUseProgram(bodyProgram);
+    glUniform2f(bodyScreen, static_cast<float>(width), static_cast<float>(height));
+    glBindVertexArray(bodyVao);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, reinterpret_cast<const void *>(base + lineFloats * sizeof(float)));
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, static_cast<GLsizei>(n));
+  }
+  glBindVertexArray(0);
+  stream.Fence();
+}
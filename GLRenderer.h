@@ -0,0 +1,66 @@
+#ifndef _GLRENDERER_H_
+#define _GLRENDERER_H_
+
+#include "./Dependencies/include/GL/glew.h"
+#include "Transform.h"
+#include <vector>
+
+//Vertex data rewritten by the CPU every frame. With buffer storage the buffer is mapped once and cycled
+//through three fenced regions; without it each frame orphans the buffer and re-uploads.
+class StreamBuffer
+{
+public:
+  GLuint buffer;
+
+  StreamBuffer();
+
+  bool Create(size_t regionBytes, bool persistent);
+  void Destroy();
+  //Space for this frame's vertices; only valid until Commit
+  void *Begin(size_t bytes);
+  //Makes the written vertices visible to GL and returns their offset in the buffer
+  GLintptr Commit();
+  //Marks the end of the draws reading this frame's region
+  void Fence();
+  bool Persistent() const { return persistent; }
+
+private:
+  static const int REGIONS = 3;
+  bool persistent;
+  size_t regionBytes;
+  int region;
+  size_t used;
+  unsigned char *mapped;
+  GLsync fences[REGIONS];
+  std::vector<unsigned char> staging;
+
+  void Wait(int r);
+};
+
+//Draws every body as one instanced impostor sphere and each trail as a line strip on the window's GL context
+class GLRenderer
+{
+public:
+  GLRenderer();
+  ~GLRenderer();
+
+  //Needs a current context; compiles the shaders and sets up the buffers
+  bool Init();
+  void Shutdown();
+  //Draws the bodies listed in visible; radii are (ceil(mass * pixelsPerMass) + 1) / 2 pixels, matching the SDL renderer
+  void Draw(int width, int height, const ScreenPoints &bodies, const double *mass, double pixelsPerMass,
+            const std::vector<int> &visible, const ScreenPoints &trail, const std::vector<int> &trailStarts, int follow);
+  bool Persistent() const { return stream.Persistent(); }
+
+private:
+  GLuint bodyProgram, lineProgram;
+  GLint bodyScreen, lineScreen;
+  GLuint bodyVao, lineVao;
+  GLuint quad;
+  StreamBuffer stream;
+  std::vector<GLint> firsts;
+  std::vector<GLsizei> counts;
+  bool ready;
+};
+
+#endif
@@ -0,0 +1,141 @@
+#include "Gravity.h"
+#include <cmath>
+#include <string>
+
+Gravity::Gravity() : solver(SOLVER_DIRECT), G(6.674 / pow(10, 11)), theta(0.5), order(4), pool(nullptr), isa(DetectIsa()), precision(PRECISION_DOUBLE), potential(false)
+{
+}
+
+void Gravity::Accelerations(Bodies &bodies)
+{
+  if (potential)
+    phi.resize(bodies.size());
+  switch (solver)
+  {
+  case SOLVER_BARNES_HUT:
+    BarnesHut(bodies);
+    break;
+  case SOLVER_FMM:
+    //The expansions are of 1 / r, so the other force laws stay on the tree walk
+    if (law.kind == LAW_NEWTON)
+      Multipole(bodies);
+    else
+      BarnesHut(bodies);
+    break;
+  default:
+    Direct(bodies);
+    break;
+  }
+}
+
+void Gravity::Direct(Bodies &bodies)
+{
+  int n = bodies.size();
+  double *ax = bodies.ax.data();
+  double *ay = bodies.ay.data();
+  double *az = bodies.az.data();
+  double *p = potential ? phi.data() : nullptr;
+  ThreadPool::Task task;
+  //Each body is summed by exactly one task in a fixed j order, so results do not depend on the thread count
+  if (precision == PRECISION_SINGLE)
+  {
+    fx.assign(bodies.x.begin(), bodies.x.end());
+    fy.assign(bodies.y.begin(), bodies.y.end());
+    fz.assign(bodies.z.begin(), bodies.z.end());
+    fm.assign(bodies.mass.begin(), bodies.mass.end());
+    const float *x = fx.data(), *y = fy.data(), *z = fz.data(), *m = fm.data();
+    float g = G;
+    KernelIsa kernel = isa;
+    ForceLaw pair = law;
+    task = [=](int begin, int end, int) {
+      PairwiseAccel(kernel, pair, begin, end, n, x, y, z, m, g, ax, ay, az, p);
+    };
+  }
+  else
+  {
+    const double *x = bodies.x.data(), *y = bodies.y.data(), *z = bodies.z.data(), *m = bodies.mass.data();
+    double g = G;
+    KernelIsa kernel = isa;
+    ForceLaw pair = law;
+    task = [=](int begin, int end, int) {
+      PairwiseAccel(kernel, pair, begin, end, n, x, y, z, m, g, ax, ay, az, p);
+    };
+  }
+  if (pool)
+    pool->ParallelFor(n, 16, task);
+  else
+    task(0, n, 0);
+}
+
+void Gravity::BarnesHut(Bodies &bodies)
+{
+  tree.Build(bodies);
+  work.resize(pool ? pool->Size() : 1);
+  switch (law.kind)
+  {
+  case LAW_PLUMMER:
+    Walk(bodies, PlummerLaw<double>(law));
+    break;
+  case LAW_SPLINE:
+    Walk(bodies, SplineLaw<double>(law));
+    break;
+  case LAW_YUKAWA:
+    Walk(bodies, YukawaLaw<double>(law));
+    break;
+  default:
+    Walk(bodies, NewtonLaw<double>(law));
+    break;
+  }
+}
+
+template <class Law>
+void Gravity::Walk(Bodies &bodies, const Law &law)
+{
+  int n = bodies.size();
+  double *ax = bodies.ax.data();
+  double *ay = bodies.ay.data();
+  double *az = bodies.az.data();
+  double *p = potential ? phi.data() : nullptr;
+  ThreadPool::Task task = [&](int begin, int end, int worker) {
+    for (int i = begin; i < end; i++)
+      tree.Accel(law, i, theta, G, ax[i], ay[i], az[i], work[worker], p ? p + i : nullptr);
+  };
+  if (pool)
+    pool->ParallelFor(n, 64, task);
+  else
+    task(0, n, 0);
+}
+
+void Gravity::Multipole(Bodies &bodies)
+{
+  fmm.order = order;
+  fmm.theta = theta;
+  fmm.isa = isa;
+  fmm.Accelerations(bodies, G, pool, bodies.ax.data(), bodies.ay.data(), bodies.az.data(), potential ? phi.data() : nullptr);
+}
+
+bool ParseSolver(const std::string &name, GravitySolver &solver)
+{
+  if (name == "direct")
+    solver = SOLVER_DIRECT;
+  else if (name == "barneshut" || name == "bh")
+    solver = SOLVER_BARNES_HUT;
+  else if (name == "fmm")
+    solver = SOLVER_FMM;
+  else
+    return false;
+  return true;
+}
+
+const char *SolverName(GravitySolver solver)
+{
+  switch (solver)
+  {
+  case SOLVER_BARNES_HUT:
+    return "barneshut";
+  case SOLVER_FMM:
+    return "fmm";
+  default:
+    return "direct";
+  }
+}
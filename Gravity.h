@@ -0,0 +1,55 @@
+#ifndef _GRAVITY_H_
+#define _GRAVITY_H_
+
+#include "Bodies.h"
+#include "Fmm.h"
+#include "Kernel.h"
+#include "Octree.h"
+#include "ThreadPool.h"
+#include <string>
+
+enum GravitySolver
+{
+  SOLVER_DIRECT,
+  SOLVER_BARNES_HUT,
+  SOLVER_FMM
+};
+
+//Fills the acceleration arrays of a body store with the selected force engine
+class Gravity
+{
+private:
+  Octree tree;
+  Fmm fmm;
+  std::vector<std::vector<int>> work; //Traversal stack per worker
+  AlignedFloats fx, fy, fz, fm;       //Single precision copies for the float kernel
+
+  template <class Law>
+  void Walk(Bodies &bodies, const Law &law);
+
+public:
+  GravitySolver solver;
+  double G;
+  //Barnes-Hut opening angle, and the FMM's (r_a + r_b) / distance limit. Kept in (0, 1]: above about 1.15 a cell can
+  //pass the opening test for a body inside it, and above 1 the FMM would expand across overlapping cells.
+  double theta;
+  int order;    //FMM expansion degree
+  ThreadPool *pool;
+  KernelIsa isa;
+  KernelPrecision precision;
+  ForceLaw law;       //Pair interaction and its softening, shared by every solver
+  bool potential;     //Also fill phi during the force pass
+  AlignedDoubles phi; //Potential per body, -G * sum_j m_j / r_ij (softened as the force law says), from the last pass run with potential set
+
+  Gravity();
+
+  void Accelerations(Bodies &bodies);
+  void Direct(Bodies &bodies);
+  void BarnesHut(Bodies &bodies);
+  void Multipole(Bodies &bodies);
+};
+
+bool ParseSolver(const std::string &name, GravitySolver &solver);
+const char *SolverName(GravitySolver solver);
+
+#endif
@@ -0,0 +1,238 @@
+#include "Integrator.h"
+#include "BlockHermite.h"
+#include <algorithm>
+#include <cmath>
+
+void EulerIntegrator::Step(Bodies &bodies, Gravity &gravity, double dt)
+{
+  gravity.Accelerations(bodies);
+  int n = bodies.size();
+  double *x = bodies.x.data(), *y = bodies.y.data(), *z = bodies.z.data();
+  double *vx = bodies.vx.data(), *vy = bodies.vy.data(), *vz = bodies.vz.data();
+  const double *ax = bodies.ax.data(), *ay = bodies.ay.data(), *az = bodies.az.data();
+  for (int i = 0; i < n; i++)
+  {
+    vx[i] += ax[i] * dt;
+    vy[i] += ay[i] * dt;
+    vz[i] += az[i] * dt;
+    x[i] += vx[i] * dt;
+    y[i] += vy[i] * dt;
+    z[i] += vz[i] * dt;
+  }
+}
+
+static void Kick(Bodies &bodies, double dt)
+{
+  int n = bodies.size();
+  double *vx = bodies.vx.data(), *vy = bodies.vy.data(), *vz = bodies.vz.data();
+  const double *ax = bodies.ax.data(), *ay = bodies.ay.data(), *az = bodies.az.data();
+  for (int i = 0; i < n; i++)
+  {
+    vx[i] += ax[i] * dt;
+    vy[i] += ay[i] * dt;
+    vz[i] += az[i] * dt;
+  }
+}
+
+static void Drift(Bodies &bodies, double dt)
+{
+  int n = bodies.size();
+  double *x = bodies.x.data(), *y = bodies.y.data(), *z = bodies.z.data();
+  const double *vx = bodies.vx.data(), *vy = bodies.vy.data(), *vz = bodies.vz.data();
+  for (int i = 0; i < n; i++)
+  {
+    x[i] += vx[i] * dt;
+    y[i] += vy[i] * dt;
+    z[i] += vz[i] * dt;
+  }
+}
+
+void LeapfrogIntegrator::Step(Bodies &bodies, Gravity &gravity, double dt)
+{
+  //Forces from the end of the last step are still current unless the bodies changed
+  if (!valid)
+    gravity.Accelerations(bodies);
+  Kick(bodies, dt / 2);
+  Drift(bodies, dt);
+  gravity.Accelerations(bodies);
+  Kick(bodies, dt / 2);
+  valid = true;
+}
+
+void YoshidaIntegrator::Step(Bodies &bodies, Gravity &gravity, double dt)
+{
+  static const double cbrt2 = cbrt(2.0);
+  static const double w1 = 1 / (2 - cbrt2);
+  static const double w0 = -cbrt2 / (2 - cbrt2);
+  static const double c[4] = {w1 / 2, (w0 + w1) / 2, (w0 + w1) / 2, w1 / 2};
+  static const double d[3] = {w1, w0, w1};
+  for (int k = 0; k < 3; k++)
+  {
+    Drift(bodies, c[k] * dt);
+    gravity.Accelerations(bodies);
+    Kick(bodies, d[k] * dt);
+  }
+  Drift(bodies, c[3] * dt);
+}
+
+//Dormand-Prince tableau
+static const double A[7][6] = {
+    {0, 0, 0, 0, 0, 0},
+    {1.0 / 5, 0, 0, 0, 0, 0},
+    {3.0 / 40, 9.0 / 40, 0, 0, 0, 0},
+    {44.0 / 45, -56.0 / 15, 32.0 / 9, 0, 0, 0},
+    {19372.0 / 6561, -25360.0 / 2187, 64448.0 / 6561, -212.0 / 729, 0, 0},
+    {9017.0 / 3168, -355.0 / 33, 46732.0 / 5247, 49.0 / 176, -5103.0 / 18656, 0},
+    {35.0 / 384, 0, 500.0 / 1113, 125.0 / 192, -2187.0 / 6784, 11.0 / 84}};
+static const double B5[7] = {35.0 / 384, 0, 500.0 / 1113, 125.0 / 192, -2187.0 / 6784, 11.0 / 84, 0};
+static const double B4[7] = {5179.0 / 57600, 0, 7571.0 / 16695, 393.0 / 640, -92097.0 / 339200, 187.0 / 2100, 1.0 / 40};
+
+//Tries one step of size step from the saved state; leaves the fifth order result in bodies and returns the scaled error
+double RK45Integrator::Attempt(Bodies &bodies, Gravity &gravity, double step)
+{
+  int n = bodies.size();
+  for (int s = 0; s < 7; s++)
+  {
+    for (int i = 0; i < n; i++)
+    {
+      double px = x0[i], py = y0[i], pz = z0[i];
+      double qx = vx0[i], qy = vy0[i], qz = vz0[i];
+      for (int r = 0; r < s; r++)
+      {
+        double a = A[s][r] * step;
+        px += a * kx[r][i];
+        py += a * ky[r][i];
+        pz += a * kz[r][i];
+        qx += a * kvx[r][i];
+        qy += a * kvy[r][i];
+        qz += a * kvz[r][i];
+      }
+      stage.x[i] = px;
+      stage.y[i] = py;
+      stage.z[i] = pz;
+      kx[s][i] = qx;
+      ky[s][i] = qy;
+      kz[s][i] = qz;
+    }
+    gravity.Accelerations(stage);
+    for (int i = 0; i < n; i++)
+    {
+      kvx[s][i] = stage.ax[i];
+      kvy[s][i] = stage.ay[i];
+      kvz[s][i] = stage.az[i];
+    }
+  }
+
+  double worst = 0;
+  for (int i = 0; i < n; i++)
+  {
+    double e[6] = {0, 0, 0, 0, 0, 0};
+    double p[6] = {x0[i], y0[i], z0[i], vx0[i], vy0[i], vz0[i]};
+    for (int s = 0; s < 7; s++)
+    {
+      double b5 = B5[s] * step;
+      double de = (B5[s] - B4[s]) * step;
+      double k[6] = {kx[s][i], ky[s][i], kz[s][i], kvx[s][i], kvy[s][i], kvz[s][i]};
+      for (int c = 0; c < 6; c++)
+      {
+        p[c] += b5 * k[c];
+        e[c] += de * k[c];
+      }
+    }
+    //Positions and velocities are scaled separately since their magnitudes differ by orders
+    double posScale = tolerance * (1 + std::max(fabs(x0[i]), std::max(fabs(y0[i]), fabs(z0[i]))));
+    double velScale = tolerance * (1 + std::max(fabs(vx0[i]), std::max(fabs(vy0[i]), fabs(vz0[i]))));
+    for (int c = 0; c < 6; c++)
+      worst = std::max(worst, fabs(e[c]) / (c < 3 ? posScale : velScale));
+    bodies.x[i] = p[0];
+    bodies.y[i] = p[1];
+    bodies.z[i] = p[2];
+    bodies.vx[i] = p[3];
+    bodies.vy[i] = p[4];
+    bodies.vz[i] = p[5];
+  }
+  return worst;
+}
+
+void RK45Integrator::Step(Bodies &bodies, Gravity &gravity, double dt)
+{
+  int n = bodies.size();
+  stage = bodies;
+  x0.resize(n);
+  y0.resize(n);
+  z0.resize(n);
+  vx0.resize(n);
+  vy0.resize(n);
+  vz0.resize(n);
+  for (int s = 0; s < 7; s++)
+  {
+    kx[s].resize(n);
+    ky[s].resize(n);
+    kz[s].resize(n);
+    kvx[s].resize(n);
+    kvy[s].resize(n);
+    kvz[s].resize(n);
+  }
+  if (h <= 0 || h > dt)
+    h = dt;
+
+  double done = 0;
+  substeps = 0;
+  while (done < dt)
+  {
+    std::copy(bodies.x.begin(), bodies.x.end(), x0.begin());
+    std::copy(bodies.y.begin(), bodies.y.end(), y0.begin());
+    std::copy(bodies.z.begin(), bodies.z.end(), z0.begin());
+    std::copy(bodies.vx.begin(), bodies.vx.end(), vx0.begin());
+    std::copy(bodies.vy.begin(), bodies.vy.end(), vy0.begin());
+    std::copy(bodies.vz.begin(), bodies.vz.end(), vz0.begin());
+    double step = std::min(h, dt - done);
+    double error = Attempt(bodies, gravity, step);
+    //Standard controller with safety factor, growth limited to 5x and shrink to 0.2x
+    double factor = error > 0 ? 0.9 * pow(error, -0.2) : 5;
+    factor = std::min(5.0, std::max(0.2, factor));
+    if (error <= 1 || step <= dt * 1e-12)
+    {
+      done += step;
+      substeps++;
+      if (step == h)
+        h *= factor;
+    }
+    else
+    {
+      //Rejected: restore the saved state and retry with a smaller step
+      std::copy(x0.begin(), x0.end(), bodies.x.begin());
+      std::copy(y0.begin(), y0.end(), bodies.y.begin());
+      std::copy(z0.begin(), z0.end(), bodies.z.begin());
+      std::copy(vx0.begin(), vx0.end(), bodies.vx.begin());
+      std::copy(vy0.begin(), vy0.end(), bodies.vy.begin());
+      std::copy(vz0.begin(), vz0.end(), bodies.vz.begin());
+      h = step * factor;
+    }
+  }
+  if (h > dt)
+    h = dt;
+  //Leave accelerations consistent with the final state for anyone reading them
+  std::copy(kvx[6].begin(), kvx[6].end(), bodies.ax.begin());
+  std::copy(kvy[6].begin(), kvy[6].end(), bodies.ay.begin());
+  std::copy(kvz[6].begin(), kvz[6].end(), bodies.az.begin());
+}
+
+Integrator *CreateIntegrator(const std::string &name, double tolerance)
+{
+  if (name == "euler")
+    return new EulerIntegrator();
+  if (name == "leapfrog" || name == "verlet")
+    return new LeapfrogIntegrator();
+  if (name == "yoshida4" || name == "yoshida")
+    return new YoshidaIntegrator();
+  if (name == "block" || name == "hermite")
+    return new BlockHermiteIntegrator();
+  if (name == "rk45")
+  {
+    RK45Integrator *rk = new RK45Integrator();
+    rk->tolerance = tolerance;
+    return rk;
+  }
+  return nullptr;
+}
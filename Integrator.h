@@ -0,0 +1,84 @@
+#ifndef _INTEGRATOR_H_
+#define _INTEGRATOR_H_
+
+#include "Bodies.h"
+#include "Gravity.h"
+#include <string>
+
+//Where a step's last force pass sees the bodies, so diagnostics can take the potential from it instead of
+//running a pass of their own
+enum ForceTiming
+{
+  FORCES_AT_START,  //One pass at the positions the step started from
+  FORCES_AT_END,    //The last pass is at the positions and matches the velocities the step ends with
+  FORCES_ELSEWHERE  //Intermediate or per-body positions only
+};
+
+//Common interface for the time integrators; Step advances every body by dt
+class Integrator
+{
+public:
+  virtual ~Integrator() {}
+  virtual const char *Name() const = 0;
+  virtual void Step(Bodies &bodies, Gravity &gravity, double dt) = 0;
+  //Called whenever bodies were added, removed or merged so cached forces are recomputed
+  virtual void Reset() {}
+  virtual ForceTiming Timing() const { return FORCES_ELSEWHERE; }
+};
+
+//Semi-implicit Euler: kick with the current forces, then drift
+class EulerIntegrator : public Integrator
+{
+public:
+  const char *Name() const { return "euler"; }
+  void Step(Bodies &bodies, Gravity &gravity, double dt);
+  ForceTiming Timing() const { return FORCES_AT_START; }
+};
+
+//Kick-drift-kick leapfrog (velocity Verlet), one force evaluation per step
+class LeapfrogIntegrator : public Integrator
+{
+private:
+  bool valid;
+
+public:
+  LeapfrogIntegrator() : valid(false) {}
+  const char *Name() const { return "leapfrog"; }
+  void Step(Bodies &bodies, Gravity &gravity, double dt);
+  void Reset() { valid = false; }
+  ForceTiming Timing() const { return FORCES_AT_END; }
+};
+
+//Yoshida's fourth order symplectic composition of leapfrog, three force evaluations per step
+class YoshidaIntegrator : public Integrator
+{
+public:
+  const char *Name() const { return "yoshida4"; }
+  void Step(Bodies &bodies, Gravity &gravity, double dt);
+};
+
+//Adaptive Dormand-Prince 5(4) Runge-Kutta; substeps inside each dt to meet the tolerance
+class RK45Integrator : public Integrator
+{
+private:
+  Bodies stage;
+  AlignedDoubles x0, y0, z0, vx0, vy0, vz0;
+  AlignedDoubles kx[7], ky[7], kz[7], kvx[7], kvy[7], kvz[7];
+  double h;
+
+  double Attempt(Bodies &bodies, Gravity &gravity, double step);
+
+public:
+  double tolerance;
+  int substeps; //Substeps taken by the last Step()
+
+  RK45Integrator() : h(0), tolerance(1e-9), substeps(0) {}
+  const char *Name() const { return "rk45"; }
+  void Step(Bodies &bodies, Gravity &gravity, double dt);
+  void Reset() { h = 0; }
+};
+
+//Also knows "block" (BlockHermite.h), which always sums forces directly. Returns nullptr for an unknown name; tolerance only applies to the adaptive integrators
+Integrator *CreateIntegrator(const std::string &name, double tolerance);
+
+#endif
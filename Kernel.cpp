@@ -0,0 +1,436 @@
+#include "Kernel.h"
+#include <cmath>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KERNEL_X86
+#include <immintrin.h>
+#endif
+
+KernelIsa DetectIsa()
+{
+#ifdef KERNEL_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f"))
+    return ISA_AVX512;
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    return ISA_AVX2;
+#endif
+  return ISA_SCALAR;
+}
+
+const char *IsaName(KernelIsa isa)
+{
+  switch (isa)
+  {
+  case ISA_AVX512:
+    return "avx512";
+  case ISA_AVX2:
+    return "avx2";
+  default:
+    return "scalar";
+  }
+}
+
+bool ParseIsa(const std::string &name, KernelIsa &isa)
+{
+  if (name == "auto")
+    isa = DetectIsa();
+  else if (name == "scalar")
+    isa = ISA_SCALAR;
+  else if (name == "avx2")
+    isa = ISA_AVX2;
+  else if (name == "avx512")
+    isa = ISA_AVX512;
+  else
+    return false;
+  //Never dispatch to something the CPU cannot run
+  if (isa > DetectIsa())
+    isa = DetectIsa();
+  return true;
+}
+
+bool ParsePrecision(const std::string &name, KernelPrecision &precision)
+{
+  if (name == "double")
+    precision = PRECISION_DOUBLE;
+  else if (name == "single" || name == "float")
+    precision = PRECISION_SINGLE;
+  else
+    return false;
+  return true;
+}
+
+//Scalar fallback, also used for the tails of the vector loops. Potential and the force law are template arguments
+//throughout so the plain Newtonian pass compiles as before and nothing in the pair loop goes through a call.
+template <bool Potential, class Law, typename T>
+static inline void AccumulateScalar(const Law &law, int i, int from, int to, const T *x, const T *y, const T *z, const T *m,
+                                    T &sx, T &sy, T &sz, T &sp)
+{
+  T xi = x[i], yi = y[i], zi = z[i];
+  for (int j = from; j < to; j++)
+  {
+    T dx = x[j] - xi;
+    T dy = y[j] - yi;
+    T dz = z[j] - zi;
+    T r2 = dx * dx + dy * dy + dz * dz;
+    if (!(r2 > 0))
+      continue;
+    T p;
+    T f = m[j] * law.Force(r2, p);
+    sx += f * dx;
+    sy += f * dy;
+    sz += f * dz;
+    if (Potential)
+      sp += m[j] * p;
+  }
+}
+
+template <bool Potential, class Law, typename T>
+static void PairwiseScalar(const Law &law, int begin, int end, int from, int to, const T *x, const T *y, const T *z, const T *m, T G,
+                           double *ax, double *ay, double *az, double *phi)
+{
+  for (int i = begin; i < end; i++)
+  {
+    T sx = 0, sy = 0, sz = 0, sp = 0;
+    AccumulateScalar<Potential>(law, i, from, to, x, y, z, m, sx, sy, sz, sp);
+    ax[i] = G * sx;
+    ay[i] = G * sy;
+    az[i] = G * sz;
+    if (Potential)
+      phi[i] = -G * sp;
+  }
+}
+
+#ifdef KERNEL_X86
+__attribute__((target("avx2,fma"))) static double HorizontalSum(__m256d v)
+{
+  __m128d lo = _mm256_castpd256_pd128(v);
+  __m128d hi = _mm256_extractf128_pd(v, 1);
+  lo = _mm_add_pd(lo, hi);
+  return _mm_cvtsd_f64(_mm_add_sd(lo, _mm_unpackhi_pd(lo, lo)));
+}
+
+__attribute__((target("avx2,fma"))) static float HorizontalSum(__m256 v)
+{
+  __m128 lo = _mm256_castps256_ps128(v);
+  __m128 hi = _mm256_extractf128_ps(v, 1);
+  lo = _mm_add_ps(lo, hi);
+  lo = _mm_add_ps(lo, _mm_movehl_ps(lo, lo));
+  return _mm_cvtss_f32(_mm_add_ss(lo, _mm_shuffle_ps(lo, lo, 1)));
+}
+
+//Redoes the lanes in mask with the law's own scalar form, for laws that differ from 1 / sqrt(r2) at short range:
+//f gets m * Force and inv the potential factor. Only pairs inside the softening length take this path.
+template <bool Potential, int Lanes, class Law, typename T, typename V>
+static inline void PatchLanes(const Law &law, unsigned mask, const V &r2, const T *m, V &f, V &inv)
+{
+  T lr2[Lanes], lf[Lanes], linv[Lanes];
+  memcpy(lr2, &r2, sizeof(V));
+  memcpy(lf, &f, sizeof(V));
+  if (Potential)
+    memcpy(linv, &inv, sizeof(V));
+  for (int l = 0; l < Lanes; l++)
+  {
+    if (mask >> l & 1)
+      lf[l] = m[l] * law.Force(lr2[l], linv[l]);
+  }
+  memcpy(&f, lf, sizeof(V));
+  if (Potential)
+    memcpy(&inv, linv, sizeof(V));
+}
+
+template <bool Potential, class Law>
+__attribute__((target("avx2,fma"))) static void PairwiseAvx2(const Law &law, int begin, int end, int from, int to,
+                                                             const double *x, const double *y, const double *z, const double *m, double G,
+                                                             double *ax, double *ay, double *az, double *phi)
+{
+  const __m256d one = _mm256_set1_pd(1.0);
+  const __m256d zero = _mm256_setzero_pd();
+  const __m256d offset = _mm256_set1_pd(law.Offset());
+  const __m256d patch = _mm256_set1_pd(law.Patch());
+  int vn = from + ((to - from) & ~3);
+  for (int i = begin; i < end; i++)
+  {
+    __m256d xi = _mm256_set1_pd(x[i]);
+    __m256d yi = _mm256_set1_pd(y[i]);
+    __m256d zi = _mm256_set1_pd(z[i]);
+    __m256d sx = zero, sy = zero, sz = zero, sp = zero;
+    for (int j = from; j < vn; j += 4)
+    {
+      __m256d dx = _mm256_sub_pd(_mm256_loadu_pd(x + j), xi);
+      __m256d dy = _mm256_sub_pd(_mm256_loadu_pd(y + j), yi);
+      __m256d dz = _mm256_sub_pd(_mm256_loadu_pd(z + j), zi);
+      __m256d r2 = _mm256_fmadd_pd(dz, dz, _mm256_fmadd_pd(dy, dy, _mm256_mul_pd(dx, dx)));
+      __m256d live = _mm256_cmp_pd(r2, zero, _CMP_GT_OQ);
+      __m256d inv = _mm256_div_pd(one, _mm256_sqrt_pd(Law::softened ? _mm256_add_pd(r2, offset) : r2));
+      inv = _mm256_and_pd(inv, live);
+      __m256d f = _mm256_mul_pd(_mm256_loadu_pd(m + j), _mm256_mul_pd(inv, _mm256_mul_pd(inv, inv)));
+      if (Law::patched)
+      {
+        int close = _mm256_movemask_pd(_mm256_and_pd(live, _mm256_cmp_pd(r2, patch, _CMP_LT_OQ)));
+        if (close)
+          PatchLanes<Potential, 4>(law, close, r2, m + j, f, inv);
+      }
+      sx = _mm256_fmadd_pd(f, dx, sx);
+      sy = _mm256_fmadd_pd(f, dy, sy);
+      sz = _mm256_fmadd_pd(f, dz, sz);
+      if (Potential)
+        sp = _mm256_fmadd_pd(_mm256_loadu_pd(m + j), inv, sp);
+    }
+    double tx = HorizontalSum(sx), ty = HorizontalSum(sy), tz = HorizontalSum(sz), tp = Potential ? HorizontalSum(sp) : 0;
+    AccumulateScalar<Potential>(law, i, vn, to, x, y, z, m, tx, ty, tz, tp);
+    ax[i] = G * tx;
+    ay[i] = G * ty;
+    az[i] = G * tz;
+    if (Potential)
+      phi[i] = -G * tp;
+  }
+}
+
+template <bool Potential, class Law>
+__attribute__((target("avx2,fma"))) static void PairwiseAvx2(const Law &law, int begin, int end, int from, int to,
+                                                             const float *x, const float *y, const float *z, const float *m, float G,
+                                                             double *ax, double *ay, double *az, double *phi)
+{
+  const __m256 half = _mm256_set1_ps(0.5f);
+  const __m256 threeHalves = _mm256_set1_ps(1.5f);
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 offset = _mm256_set1_ps(law.Offset());
+  const __m256 patch = _mm256_set1_ps(law.Patch());
+  int vn = from + ((to - from) & ~7);
+  for (int i = begin; i < end; i++)
+  {
+    __m256 xi = _mm256_set1_ps(x[i]);
+    __m256 yi = _mm256_set1_ps(y[i]);
+    __m256 zi = _mm256_set1_ps(z[i]);
+    __m256 sx = zero, sy = zero, sz = zero, sp = zero;
+    for (int j = from; j < vn; j += 8)
+    {
+      __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(x + j), xi);
+      __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(y + j), yi);
+      __m256 dz = _mm256_sub_ps(_mm256_loadu_ps(z + j), zi);
+      __m256 r2 = _mm256_fmadd_ps(dz, dz, _mm256_fmadd_ps(dy, dy, _mm256_mul_ps(dx, dx)));
+      __m256 live = _mm256_cmp_ps(r2, zero, _CMP_GT_OQ);
+      __m256 s = Law::softened ? _mm256_add_ps(r2, offset) : r2;
+      //Hardware estimate refined by one Newton step
+      __m256 inv = _mm256_rsqrt_ps(s);
+      inv = _mm256_mul_ps(inv, _mm256_fnmadd_ps(_mm256_mul_ps(half, s), _mm256_mul_ps(inv, inv), threeHalves));
+      inv = _mm256_and_ps(inv, live);
+      __m256 f = _mm256_mul_ps(_mm256_loadu_ps(m + j), _mm256_mul_ps(inv, _mm256_mul_ps(inv, inv)));
+      if (Law::patched)
+      {
+        int close = _mm256_movemask_ps(_mm256_and_ps(live, _mm256_cmp_ps(r2, patch, _CMP_LT_OQ)));
+        if (close)
+          PatchLanes<Potential, 8>(law, close, r2, m + j, f, inv);
+      }
+      sx = _mm256_fmadd_ps(f, dx, sx);
+      sy = _mm256_fmadd_ps(f, dy, sy);
+      sz = _mm256_fmadd_ps(f, dz, sz);
+      if (Potential)
+        sp = _mm256_fmadd_ps(_mm256_loadu_ps(m + j), inv, sp);
+    }
+    float tx = HorizontalSum(sx), ty = HorizontalSum(sy), tz = HorizontalSum(sz), tp = Potential ? HorizontalSum(sp) : 0;
+    AccumulateScalar<Potential>(law, i, vn, to, x, y, z, m, tx, ty, tz, tp);
+    ax[i] = G * tx;
+    ay[i] = G * ty;
+    az[i] = G * tz;
+    if (Potential)
+      phi[i] = -G * tp;
+  }
+}
+
+template <bool Potential, class Law>
+__attribute__((target("avx512f"))) static void PairwiseAvx512(const Law &law, int begin, int end, int from, int to,
+                                                              const double *x, const double *y, const double *z, const double *m, double G,
+                                                              double *ax, double *ay, double *az, double *phi)
+{
+  const __m512d one = _mm512_set1_pd(1.0);
+  const __m512d zero = _mm512_setzero_pd();
+  const __m512d offset = _mm512_set1_pd(law.Offset());
+  const __m512d patch = _mm512_set1_pd(law.Patch());
+  int vn = from + ((to - from) & ~7);
+  for (int i = begin; i < end; i++)
+  {
+    __m512d xi = _mm512_set1_pd(x[i]);
+    __m512d yi = _mm512_set1_pd(y[i]);
+    __m512d zi = _mm512_set1_pd(z[i]);
+    __m512d sx = zero, sy = zero, sz = zero, sp = zero;
+    for (int j = from; j < vn; j += 8)
+    {
+      __m512d dx = _mm512_sub_pd(_mm512_loadu_pd(x + j), xi);
+      __m512d dy = _mm512_sub_pd(_mm512_loadu_pd(y + j), yi);
+      __m512d dz = _mm512_sub_pd(_mm512_loadu_pd(z + j), zi);
+      __m512d r2 = _mm512_fmadd_pd(dz, dz, _mm512_fmadd_pd(dy, dy, _mm512_mul_pd(dx, dx)));
+      __mmask8 live = _mm512_cmp_pd_mask(r2, zero, _CMP_GT_OQ);
+      __m512d inv = _mm512_maskz_div_pd(live, one, _mm512_sqrt_pd(Law::softened ? _mm512_add_pd(r2, offset) : r2));
+      __m512d f = _mm512_mul_pd(_mm512_loadu_pd(m + j), _mm512_mul_pd(inv, _mm512_mul_pd(inv, inv)));
+      if (Law::patched)
+      {
+        __mmask8 close = _mm512_mask_cmp_pd_mask(live, r2, patch, _CMP_LT_OQ);
+        if (close)
+          PatchLanes<Potential, 8>(law, close, r2, m + j, f, inv);
+      }
+      sx = _mm512_fmadd_pd(f, dx, sx);
+      sy = _mm512_fmadd_pd(f, dy, sy);
+      sz = _mm512_fmadd_pd(f, dz, sz);
+      if (Potential)
+        sp = _mm512_fmadd_pd(_mm512_loadu_pd(m + j), inv, sp);
+    }
+    double tx = _mm512_reduce_add_pd(sx), ty = _mm512_reduce_add_pd(sy), tz = _mm512_reduce_add_pd(sz);
+    double tp = Potential ? _mm512_reduce_add_pd(sp) : 0;
+    AccumulateScalar<Potential>(law, i, vn, to, x, y, z, m, tx, ty, tz, tp);
+    ax[i] = G * tx;
+    ay[i] = G * ty;
+    az[i] = G * tz;
+    if (Potential)
+      phi[i] = -G * tp;
+  }
+}
+
+template <bool Potential, class Law>
+__attribute__((target("avx512f"))) static void PairwiseAvx512(const Law &law, int begin, int end, int from, int to,
+                                                              const float *x, const float *y, const float *z, const float *m, float G,
+                                                              double *ax, double *ay, double *az, double *phi)
+{
+  const __m512 half = _mm512_set1_ps(0.5f);
+  const __m512 threeHalves = _mm512_set1_ps(1.5f);
+  const __m512 zero = _mm512_setzero_ps();
+  const __m512 offset = _mm512_set1_ps(law.Offset());
+  const __m512 patch = _mm512_set1_ps(law.Patch());
+  int vn = from + ((to - from) & ~15);
+  for (int i = begin; i < end; i++)
+  {
+    __m512 xi = _mm512_set1_ps(x[i]);
+    __m512 yi = _mm512_set1_ps(y[i]);
+    __m512 zi = _mm512_set1_ps(z[i]);
+    __m512 sx = zero, sy = zero, sz = zero, sp = zero;
+    for (int j = from; j < vn; j += 16)
+    {
+      __m512 dx = _mm512_sub_ps(_mm512_loadu_ps(x + j), xi);
+      __m512 dy = _mm512_sub_ps(_mm512_loadu_ps(y + j), yi);
+      __m512 dz = _mm512_sub_ps(_mm512_loadu_ps(z + j), zi);
+      __m512 r2 = _mm512_fmadd_ps(dz, dz, _mm512_fmadd_ps(dy, dy, _mm512_mul_ps(dx, dx)));
+      __mmask16 live = _mm512_cmp_ps_mask(r2, zero, _CMP_GT_OQ);
+      __m512 s = Law::softened ? _mm512_add_ps(r2, offset) : r2;
+      __m512 inv = _mm512_maskz_rsqrt14_ps(live, s);
+      inv = _mm512_mul_ps(inv, _mm512_fnmadd_ps(_mm512_mul_ps(half, s), _mm512_mul_ps(inv, inv), threeHalves));
+      __m512 f = _mm512_mul_ps(_mm512_loadu_ps(m + j), _mm512_mul_ps(inv, _mm512_mul_ps(inv, inv)));
+      if (Law::patched)
+      {
+        __mmask16 close = _mm512_mask_cmp_ps_mask(live, r2, patch, _CMP_LT_OQ);
+        if (close)
+          PatchLanes<Potential, 16>(law, close, r2, m + j, f, inv);
+      }
+      sx = _mm512_fmadd_ps(f, dx, sx);
+      sy = _mm512_fmadd_ps(f, dy, sy);
+      sz = _mm512_fmadd_ps(f, dz, sz);
+      if (Potential)
+        sp = _mm512_fmadd_ps(_mm512_loadu_ps(m + j), inv, sp);
+    }
+    float tx = _mm512_reduce_add_ps(sx), ty = _mm512_reduce_add_ps(sy), tz = _mm512_reduce_add_ps(sz);
+    float tp = Potential ? _mm512_reduce_add_ps(sp) : 0;
+    AccumulateScalar<Potential>(law, i, vn, to, x, y, z, m, tx, ty, tz, tp);
+    ax[i] = G * tx;
+    ay[i] = G * ty;
+    az[i] = G * tz;
+    if (Potential)
+      phi[i] = -G * tp;
+  }
+}
+#endif
+
+template <bool Potential, class Law, typename T>
+static void PairwiseDispatch(KernelIsa isa, const Law &law, int begin, int end, int from, int to,
+                             const T *x, const T *y, const T *z, const T *m, T G,
+                             double *ax, double *ay, double *az, double *phi)
+{
+#ifdef KERNEL_X86
+  if (Law::vectorized && isa == ISA_AVX512)
+    return PairwiseAvx512<Potential>(law, begin, end, from, to, x, y, z, m, G, ax, ay, az, phi);
+  if (Law::vectorized && isa == ISA_AVX2)
+    return PairwiseAvx2<Potential>(law, begin, end, from, to, x, y, z, m, G, ax, ay, az, phi);
+#endif
+  PairwiseScalar<Potential>(law, begin, end, from, to, x, y, z, m, G, ax, ay, az, phi);
+}
+
+template <class Law, typename T>
+static void PairwiseLaw(KernelIsa isa, const Law &law, int begin, int end, int from, int to,
+                        const T *x, const T *y, const T *z, const T *m, T G,
+                        double *ax, double *ay, double *az, double *phi)
+{
+  if (phi != nullptr)
+    PairwiseDispatch<true>(isa, law, begin, end, from, to, x, y, z, m, G, ax, ay, az, phi);
+  else
+    PairwiseDispatch<false>(isa, law, begin, end, from, to, x, y, z, m, G, ax, ay, az, phi);
+}
+
+//The one switch on the law per call; everything below it is compiled for that law
+template <typename T>
+static void PairwiseAny(KernelIsa isa, const ForceLaw &law, int begin, int end, int from, int to,
+                        const T *x, const T *y, const T *z, const T *m, T G,
+                        double *ax, double *ay, double *az, double *phi)
+{
+  switch (law.kind)
+  {
+  case LAW_PLUMMER:
+    return PairwiseLaw(isa, PlummerLaw<T>(law), begin, end, from, to, x, y, z, m, G, ax, ay, az, phi);
+  case LAW_SPLINE:
+    return PairwiseLaw(isa, SplineLaw<T>(law), begin, end, from, to, x, y, z, m, G, ax, ay, az, phi);
+  case LAW_YUKAWA:
+    return PairwiseLaw(isa, YukawaLaw<T>(law), begin, end, from, to, x, y, z, m, G, ax, ay, az, phi);
+  default:
+    return PairwiseLaw(isa, NewtonLaw<T>(law), begin, end, from, to, x, y, z, m, G, ax, ay, az, phi);
+  }
+}
+
+void PairwiseAccel(KernelIsa isa, const ForceLaw &law, int begin, int end, int n,
+                   const double *x, const double *y, const double *z, const double *m, double G,
+                   double *ax, double *ay, double *az, double *phi)
+{
+  PairwiseAny(isa, law, begin, end, 0, n, x, y, z, m, G, ax, ay, az, phi);
+}
+
+void PairwiseAccel(KernelIsa isa, const ForceLaw &law, int begin, int end, int n,
+                   const float *x, const float *y, const float *z, const float *m, float G,
+                   double *ax, double *ay, double *az, double *phi)
+{
+  PairwiseAny(isa, law, begin, end, 0, n, x, y, z, m, G, ax, ay, az, phi);
+}
+
+void PairwiseBlock(KernelIsa isa, const ForceLaw &law, int begin, int end, int from, int to,
+                   const double *x, const double *y, const double *z, const double *m, double G,
+                   double *ax, double *ay, double *az, double *phi)
+{
+  PairwiseAny(isa, law, begin, end, from, to, x, y, z, m, G, ax, ay, az, phi);
+}
+
+bool ParseForceLaw(const std::string &name, ForceLawKind &kind)
+{
+  if (name == "newton")
+    kind = LAW_NEWTON;
+  else if (name == "plummer")
+    kind = LAW_PLUMMER;
+  else if (name == "spline")
+    kind = LAW_SPLINE;
+  else if (name == "yukawa")
+    kind = LAW_YUKAWA;
+  else
+    return false;
+  return true;
+}
+
+const char *ForceLawName(ForceLawKind kind)
+{
+  switch (kind)
+  {
+  case LAW_PLUMMER:
+    return "plummer";
+  case LAW_SPLINE:
+    return "spline";
+  case LAW_YUKAWA:
+    return "yukawa";
+  default:
+    return "newton";
+  }
+}
@@ -0,0 +1,40 @@
+#ifndef _KERNEL_H_
+#define _KERNEL_H_
+
+#include "ForceLaw.h"
+#include <string>
+
+enum KernelIsa
+{
+  ISA_SCALAR,
+  ISA_AVX2,
+  ISA_AVX512
+};
+
+enum KernelPrecision
+{
+  PRECISION_DOUBLE,
+  PRECISION_SINGLE
+};
+
+//Best instruction set the running CPU supports and this build was compiled for
+KernelIsa DetectIsa();
+const char *IsaName(KernelIsa isa);
+bool ParseIsa(const std::string &name, KernelIsa &isa);
+bool ParsePrecision(const std::string &name, KernelPrecision &precision);
+
+//Pairwise gravity for targets [begin, end) against all n sources: a_i = G * sum_j m_j * f(r_ij) * r_ij, with
+//f = 1 / |r_ij|^3 for the Newtonian law. Pairs at zero separation (the body itself) contribute nothing.
+//When phi is given the same pass also stores the potential phi_i = -G * sum_j m_j * p(r_ij).
+void PairwiseAccel(KernelIsa isa, const ForceLaw &law, int begin, int end, int n,
+                   const double *x, const double *y, const double *z, const double *m, double G,
+                   double *ax, double *ay, double *az, double *phi = nullptr);
+void PairwiseAccel(KernelIsa isa, const ForceLaw &law, int begin, int end, int n,
+                   const float *x, const float *y, const float *z, const float *m, float G,
+                   double *ax, double *ay, double *az, double *phi = nullptr);
+//Same for targets [begin, end) against the sources [from, to) of the same arrays, as for two leaves of a tree
+void PairwiseBlock(KernelIsa isa, const ForceLaw &law, int begin, int end, int from, int to,
+                   const double *x, const double *y, const double *z, const double *m, double G,
+                   double *ax, double *ay, double *az, double *phi = nullptr);
+
+#endif
@@ -0,0 +1,198 @@
+#include "Octree.h"
+#include <cmath>
+#include <algorithm>
+
+Octree::Octree() : px(nullptr), py(nullptr), pz(nullptr), pm(nullptr), leafSize(8), maxDepth(48)
+{
+}
+
+void Octree::Build(const Bodies &bodies)
+{
+  int n = bodies.size();
+  px = bodies.x.data();
+  py = bodies.y.data();
+  pz = bodies.z.data();
+  pm = bodies.mass.data();
+  nodes.clear();
+  index.resize(n);
+  scratch.resize(n);
+  if (n == 0)
+    return;
+
+  double minx = px[0], maxx = px[0];
+  double miny = py[0], maxy = py[0];
+  double minz = pz[0], maxz = pz[0];
+  for (int i = 0; i < n; i++)
+  {
+    index[i] = i;
+    minx = std::min(minx, px[i]);
+    maxx = std::max(maxx, px[i]);
+    miny = std::min(miny, py[i]);
+    maxy = std::max(maxy, py[i]);
+    minz = std::min(minz, pz[i]);
+    maxz = std::max(maxz, pz[i]);
+  }
+  double half = std::max(maxx - minx, std::max(maxy - miny, maxz - minz)) / 2;
+  //Pad slightly so bodies on the boundary fall strictly inside the root cell
+  half = half * 1.0001 + 1e-9;
+  nodes.reserve(2 * n / leafSize + 8);
+  BuildNode(0, n, (minx + maxx) / 2, (miny + maxy) / 2, (minz + maxz) / 2, half, 0);
+}
+
+int Octree::BuildNode(int begin, int end, double cx, double cy, double cz, double half, int depth)
+{
+  int id = nodes.size();
+  nodes.push_back(OctreeNode());
+  OctreeNode node;
+  node.cx = cx;
+  node.cy = cy;
+  node.cz = cz;
+  node.half = half;
+  node.begin = begin;
+  node.end = end;
+  for (int k = 0; k < 8; k++)
+    node.child[k] = -1;
+
+  if (end - begin <= leafSize || depth >= maxDepth)
+  {
+    node.leaf = true;
+    node.mass = node.mx = node.my = node.mz = 0;
+    for (int k = begin; k < end; k++)
+    {
+      int b = index[k];
+      node.mass += pm[b];
+      node.mx += pm[b] * px[b];
+      node.my += pm[b] * py[b];
+      node.mz += pm[b] * pz[b];
+    }
+  }
+  else
+  {
+    //Counting sort of the range into octants
+    int count[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    for (int k = begin; k < end; k++)
+    {
+      int b = index[k];
+      int oct = (px[b] >= cx ? 1 : 0) | (py[b] >= cy ? 2 : 0) | (pz[b] >= cz ? 4 : 0);
+      count[oct]++;
+    }
+    int start[9];
+    start[0] = begin;
+    for (int k = 0; k < 8; k++)
+      start[k + 1] = start[k] + count[k];
+    int fill[8];
+    for (int k = 0; k < 8; k++)
+      fill[k] = start[k];
+    for (int k = begin; k < end; k++)
+    {
+      int b = index[k];
+      int oct = (px[b] >= cx ? 1 : 0) | (py[b] >= cy ? 2 : 0) | (pz[b] >= cz ? 4 : 0);
+      scratch[fill[oct]++] = b;
+    }
+    std::copy(scratch.begin() + begin, scratch.begin() + end, index.begin() + begin);
+
+    node.leaf = false;
+    node.mass = node.mx = node.my = node.mz = 0;
+    double h = half / 2;
+    for (int k = 0; k < 8; k++)
+    {
+      if (count[k] == 0)
+        continue;
+      int c = BuildNode(start[k], start[k + 1],
+                        cx + ((k & 1) ? h : -h),
+                        cy + ((k & 2) ? h : -h),
+                        cz + ((k & 4) ? h : -h),
+                        h, depth + 1);
+      node.child[k] = c;
+      node.mass += nodes[c].mass;
+      node.mx += nodes[c].mx;
+      node.my += nodes[c].my;
+      node.mz += nodes[c].mz;
+    }
+  }
+  nodes[id] = node;
+  return id;
+}
+
+template <class Law>
+void Octree::Accel(const Law &law, int i, double theta, double G, double &ax, double &ay, double &az, std::vector<int> &work,
+                   double *phi) const
+{
+  ax = ay = az = 0;
+  double potential = 0;
+  if (phi != nullptr)
+    *phi = 0;
+  if (nodes.empty())
+    return;
+  double xi = px[i], yi = py[i], zi = pz[i];
+  double theta2 = theta * theta;
+  work.clear();
+  work.push_back(0);
+  while (!work.empty())
+  {
+    const OctreeNode &node = nodes[work.back()];
+    work.pop_back();
+    if (node.mass == 0)
+      continue;
+
+    if (!node.leaf)
+    {
+      double comx = node.mx / node.mass;
+      double comy = node.my / node.mass;
+      double comz = node.mz / node.mass;
+      double dx = comx - xi;
+      double dy = comy - yi;
+      double dz = comz - zi;
+      double r2 = dx * dx + dy * dy + dz * dz;
+      //Opening test with the center of mass offset added, so lopsided cells are opened sooner
+      double ox = comx - node.cx;
+      double oy = comy - node.cy;
+      double oz = comz - node.cz;
+      double reach = 2 * node.half + theta * sqrt(ox * ox + oy * oy + oz * oz);
+      if (reach * reach < theta2 * r2)
+      {
+        double p;
+        double f = G * node.mass * law.Force(r2, p);
+        ax += f * dx;
+        ay += f * dy;
+        az += f * dz;
+        potential -= G * node.mass * p;
+      }
+      else
+      {
+        for (int k = 0; k < 8; k++)
+        {
+          if (node.child[k] != -1)
+            work.push_back(node.child[k]);
+        }
+      }
+      continue;
+    }
+
+    for (int k = node.begin; k < node.end; k++)
+    {
+      int j = index[k];
+      if (j == i)
+        continue;
+      double dx = px[j] - xi;
+      double dy = py[j] - yi;
+      double dz = pz[j] - zi;
+      double r2 = dx * dx + dy * dy + dz * dz;
+      if (r2 == 0)
+        continue;
+      double p;
+      double f = G * pm[j] * law.Force(r2, p);
+      ax += f * dx;
+      ay += f * dy;
+      az += f * dz;
+      potential -= G * pm[j] * p;
+    }
+  }
+  if (phi != nullptr)
+    *phi = potential;
+}
+
+template void Octree::Accel(const NewtonLaw<double> &, int, double, double, double &, double &, double &, std::vector<int> &, double *) const;
+template void Octree::Accel(const PlummerLaw<double> &, int, double, double, double &, double &, double &, std::vector<int> &, double *) const;
+template void Octree::Accel(const SplineLaw<double> &, int, double, double, double &, double &, double &, std::vector<int> &, double *) const;
+template void Octree::Accel(const YukawaLaw<double> &, int, double, double, double &, double &, double &, std::vector<int> &, double *) const;
@@ -0,0 +1,46 @@
+#ifndef _OCTREE_H_
+#define _OCTREE_H_
+
+#include "Bodies.h"
+#include "ForceLaw.h"
+
+struct OctreeNode
+{
+  double cx, cy, cz, half; //Cell center and half width
+  double mass, mx, my, mz; //Total mass and center of mass
+  int child[8];
+  int begin, end; //Range into the sorted body index list
+  bool leaf;
+};
+
+//Barnes-Hut octree, rebuilt from the body arrays every step
+class Octree
+{
+private:
+  std::vector<OctreeNode> nodes;
+  std::vector<int> index;
+  std::vector<int> scratch;
+  const double *px, *py, *pz, *pm;
+
+  int BuildNode(int begin, int end, double cx, double cy, double cz, double half, int depth);
+
+public:
+  int leafSize;
+  int maxDepth;
+
+  Octree();
+
+  void Build(const Bodies &bodies);
+  //Acceleration of body i under the given law (NewtonLaw, PlummerLaw, ... over double); with phi given, also its
+  //potential from the same walk, each accepted cell as a point mass
+  template <class Law>
+  void Accel(const Law &law, int i, double theta, double G, double &ax, double &ay, double &az, std::vector<int> &work,
+             double *phi = nullptr) const;
+
+  size_t NodeCount() const { return nodes.size(); }
+  //Nodes in depth first order, every parent before its children, and body ids in the order their ranges refer to
+  const std::vector<OctreeNode> &Nodes() const { return nodes; }
+  const std::vector<int> &Index() const { return index; }
+};
+
+#endif
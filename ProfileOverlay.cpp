@@ -0,0 +1,103 @@
+#include "ProfileOverlay.h"
+#include "./Dependencies/include/SDL2/SDL.h"
+#include "./Dependencies/include/SDL2/SDL_ttf.h"
+#include <cstdio>
+
+//Tried in order when no font is given; nothing is bundled with the engine
+static const char *defaultFonts[] = {
+    "/usr/share/fonts/truetype/dejavu/DejaVuSansMono.ttf",
+    "/usr/share/fonts/TTF/DejaVuSansMono.ttf",
+    "/usr/share/fonts/dejavu/DejaVuSansMono.ttf",
+    "/System/Library/Fonts/Menlo.ttc",
+    "/Library/Fonts/Courier New.ttf",
+    "C:/Windows/Fonts/consola.ttf",
+    "C:/Windows/Fonts/cour.ttf"};
+
+//Seconds of events each update summarises
+static const double overlayWindow = 1;
+
+ProfileOverlay::ProfileOverlay() : visible(true), refresh(0.25), font(nullptr), texture(nullptr), width(0), height(0), updated(0)
+{
+}
+
+ProfileOverlay::~ProfileOverlay()
+{
+  Close();
+}
+
+bool ProfileOverlay::Open(const std::string &fontPath, int size)
+{
+  Close();
+  if (!TTF_WasInit() && TTF_Init() != 0)
+  {
+    printf("Could not initialise SDL_ttf: %s\n", TTF_GetError());
+    return false;
+  }
+  if (!fontPath.empty())
+    font = TTF_OpenFont(fontPath.c_str(), size);
+  for (size_t i = 0; font == nullptr && fontPath.empty() && i < sizeof(defaultFonts) / sizeof(defaultFonts[0]); i++)
+    font = TTF_OpenFont(defaultFonts[i], size);
+  if (font == nullptr)
+  {
+    printf("Could not open a font for the profiler overlay%s%s, give one with --font\n", fontPath.empty() ? "" : " ",
+           fontPath.c_str());
+    return false;
+  }
+  return true;
+}
+
+void ProfileOverlay::Close()
+{
+  if (texture != nullptr)
+    SDL_DestroyTexture(texture);
+  texture = nullptr;
+  if (font != nullptr)
+    TTF_CloseFont(font);
+  font = nullptr;
+}
+
+void ProfileOverlay::Update(SDL_Renderer *renderer, const Profiler &profiler)
+{
+  profiler.Summary(overlayWindow, stats);
+  std::string text = "stage        mean ms   max ms    /s";
+  char line[128];
+  for (size_t i = 0; i < stats.size(); i++)
+  {
+    const ProfileStat &s = stats[i];
+    snprintf(line, sizeof(line), "\n%-10.10s %9.3f %8.3f %5.0f", s.name, s.total / s.calls, s.worst, s.calls / overlayWindow);
+    text += line;
+  }
+
+  if (texture != nullptr)
+    SDL_DestroyTexture(texture);
+  texture = nullptr;
+  SDL_Color color = {255, 255, 160, 255};
+  SDL_Surface *surface = TTF_RenderText_Blended_Wrapped(font, text.c_str(), color, 2000);
+  if (surface == nullptr)
+    return;
+  texture = SDL_CreateTextureFromSurface(renderer, surface);
+  width = surface->w;
+  height = surface->h;
+  SDL_FreeSurface(surface);
+}
+
+void ProfileOverlay::Draw(SDL_Renderer *renderer, const Profiler &profiler)
+{
+  if (!visible || font == nullptr || renderer == nullptr)
+    return;
+  int64_t now = Profiler::Now();
+  if (texture == nullptr || now - updated > static_cast<int64_t>(refresh * 1e9))
+  {
+    Update(renderer, profiler);
+    updated = now;
+  }
+  if (texture == nullptr)
+    return;
+  SDL_Rect back = {0, 0, width + 8, height + 8};
+  SDL_Rect place = {4, 4, width, height};
+  SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+  SDL_SetRenderDrawColor(renderer, 0, 0, 0, 160);
+  SDL_RenderFillRect(renderer, &back);
+  SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
+  SDL_RenderCopy(renderer, texture, NULL, &place);
+}
@@ -0,0 +1,40 @@
+#ifndef _PROFILEOVERLAY_H_
+#define _PROFILEOVERLAY_H_
+
+#include "Profiler.h"
+#include <string>
+#include <vector>
+
+struct SDL_Renderer;
+struct SDL_Texture;
+typedef struct _TTF_Font TTF_Font;
+
+//Text panel in the window's top left corner with the mean and worst time of every profiled stage over the
+//last second. The text is only re-rendered a few times a second, so the overlay costs one texture copy a frame.
+class ProfileOverlay
+{
+public:
+  bool visible;
+  double refresh; //Seconds between text updates
+
+  ProfileOverlay();
+  ~ProfileOverlay();
+
+  //Opens fontPath, or the first of a few common system monospace fonts when it is empty
+  bool Open(const std::string &fontPath, int size);
+  void Close();
+  bool IsOpen() const { return font != nullptr; }
+
+  void Draw(SDL_Renderer *renderer, const Profiler &profiler);
+
+private:
+  TTF_Font *font;
+  SDL_Texture *texture;
+  int width, height;
+  int64_t updated;
+  std::vector<ProfileStat> stats;
+
+  void Update(SDL_Renderer *renderer, const Profiler &profiler);
+};
+
+#endif
@@ -0,0 +1,142 @@
+#include "Profiler.h"
+#include <chrono>
+#include <cstdio>
+
+#ifdef ORBIT_PROFILE
+Profiler profiler;
+#endif
+
+static const std::chrono::steady_clock::time_point profileEpoch = std::chrono::steady_clock::now();
+
+Profiler::Profiler() : slots(new Slot[capacity]), next(0), threads(0)
+{
+  for (int i = 0; i < capacity; i++)
+    slots[i].sequence.store(0, std::memory_order_relaxed);
+}
+
+int64_t Profiler::Now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - profileEpoch).count();
+}
+
+int Profiler::ThreadIndex()
+{
+  static thread_local int index = -1;
+  if (index < 0)
+    index = threads.fetch_add(1, std::memory_order_relaxed);
+  return index;
+}
+
+void Profiler::Record(const char *name, int64_t start, int64_t end)
+{
+  uint64_t index = next.fetch_add(1, std::memory_order_relaxed);
+  Slot &slot = slots[index & (capacity - 1)];
+  slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.name.store(name, std::memory_order_relaxed);
+  slot.thread.store(ThreadIndex(), std::memory_order_relaxed);
+  slot.start.store(start, std::memory_order_relaxed);
+  slot.end.store(end, std::memory_order_relaxed);
+  slot.sequence.store(2 * index + 2, std::memory_order_release);
+}
+
+bool Profiler::NameThread(const char *name)
+{
+  int index = ThreadIndex();
+  std::lock_guard<std::mutex> guard(namesLock);
+  if (names.size() <= static_cast<size_t>(index))
+    names.resize(index + 1);
+  names[index] = name;
+  return true;
+}
+
+void Profiler::Recent(double window, std::vector<ProfileEvent> &out) const
+{
+  out.clear();
+  int64_t since = window > 0 ? Now() - static_cast<int64_t>(window * 1e9) : INT64_MIN;
+  uint64_t last = next.load(std::memory_order_acquire);
+  uint64_t first = last > static_cast<uint64_t>(capacity) ? last - capacity : 0;
+  for (uint64_t index = first; index < last; index++)
+  {
+    const Slot &slot = slots[index & (capacity - 1)];
+    uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+    if (sequence != 2 * index + 2)
+      continue;
+    ProfileEvent event;
+    event.name = slot.name.load(std::memory_order_relaxed);
+    event.thread = slot.thread.load(std::memory_order_relaxed);
+    event.start = slot.start.load(std::memory_order_relaxed);
+    event.end = slot.end.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    //A writer that lapped the ring while this slot was copied leaves a different sequence behind
+    if (slot.sequence.load(std::memory_order_relaxed) != sequence || event.end < since)
+      continue;
+    out.push_back(event);
+  }
+}
+
+void Profiler::Summary(double window, std::vector<ProfileStat> &out) const
+{
+  std::vector<ProfileEvent> events;
+  Recent(window, events);
+  out.clear();
+  for (size_t i = 0; i < events.size(); i++)
+  {
+    const ProfileEvent &e = events[i];
+    size_t k = 0;
+    //Scope names are literals, so the handful of distinct pointers stands in for the names
+    while (k < out.size() && out[k].name != e.name)
+      k++;
+    if (k == out.size())
+    {
+      ProfileStat stat = {e.name, 0, 0, 0};
+      out.push_back(stat);
+    }
+    double ms = (e.end - e.start) / 1e6;
+    out[k].calls++;
+    out[k].total += ms;
+    if (ms > out[k].worst)
+      out[k].worst = ms;
+  }
+}
+
+bool Profiler::WriteTrace(const std::string &path) const
+{
+  std::vector<ProfileEvent> events;
+  Recent(0, events);
+  FILE *file = fopen(path.c_str(), "w");
+  if (file == nullptr)
+  {
+    printf("Could not write trace %s\n", path.c_str());
+    return false;
+  }
+  fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+  bool first = true;
+  {
+    std::lock_guard<std::mutex> guard(namesLock);
+    for (size_t i = 0; i < names.size(); i++)
+    {
+      if (names[i].empty())
+        continue;
+      fprintf(file, "%s\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %zu, \"args\": {\"name\": \"%s\"}}",
+              first ? "" : ",", i, names[i].c_str());
+      first = false;
+    }
+  }
+  //Complete events with microsecond times, as the format expects
+  for (size_t i = 0; i < events.size(); i++)
+  {
+    const ProfileEvent &e = events[i];
+    fprintf(file, "%s\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+            first ? "" : ",", e.name, e.thread, e.start / 1e3, (e.end - e.start) / 1e3);
+    first = false;
+  }
+  fprintf(file, "\n]}\n");
+  bool ok = ferror(file) == 0;
+  ok = fclose(file) == 0 && ok;
+  if (ok)
+    printf("%zu trace events written to %s\n", events.size(), path.c_str());
+  else
+    printf("Could not write trace %s\n", path.c_str());
+  return ok;
+}
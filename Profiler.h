@@ -0,0 +1,94 @@
+#ifndef _PROFILER_H_
+#define _PROFILER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+//One timed scope. name must outlive the profiler, in practice a string literal
+struct ProfileEvent
+{
+  const char *name;
+  int thread;
+  int64_t start, end; //Nanoseconds since the profiler started
+};
+
+//Totals of one scope name over a window of recent events
+struct ProfileStat
+{
+  const char *name;
+  long calls;
+  double total, worst; //Milliseconds
+};
+
+//Fixed ring holding the most recent scope timings from every thread. Recording takes no lock: a writer claims
+//a slot with one fetch_add and publishes it through the slot's sequence number, and readers skip any slot
+//they catch mid-write, so the overlay and trace export never stall the loops being measured.
+class Profiler
+{
+public:
+  static const int capacity = 1 << 16;
+
+  Profiler();
+
+  static int64_t Now();
+  void Record(const char *name, int64_t start, int64_t end);
+  //Gives the calling thread a name in traces; returns true so it can initialise a thread_local
+  bool NameThread(const char *name);
+
+  //Events that ended in the last window seconds, oldest first
+  void Recent(double window, std::vector<ProfileEvent> &out) const;
+  //Per name totals over the last window seconds, in order of first appearance
+  void Summary(double window, std::vector<ProfileStat> &out) const;
+  //Everything still in the ring in Chrome's trace event format, for chrome://tracing or Perfetto
+  bool WriteTrace(const std::string &path) const;
+
+private:
+  struct Slot
+  {
+    std::atomic<uint64_t> sequence; //2 * index + 2 once written, odd while a writer is inside
+    std::atomic<const char *> name;
+    std::atomic<int> thread;
+    std::atomic<int64_t> start, end;
+  };
+
+  std::unique_ptr<Slot[]> slots;
+  std::atomic<uint64_t> next;
+  std::atomic<int> threads;
+  mutable std::mutex namesLock;
+  std::vector<std::string> names;
+
+  int ThreadIndex();
+};
+
+//Only defined when ORBIT_PROFILE is, so a build without it carries no ring at all
+extern Profiler profiler;
+
+//Times the enclosing scope into profiler
+class ProfileScope
+{
+public:
+  explicit ProfileScope(const char *name) : name(name), start(Profiler::Now()) {}
+  ~ProfileScope() { profiler.Record(name, start, Profiler::Now()); }
+
+private:
+  const char *name;
+  int64_t start;
+};
+
+//Instrumentation points. Without ORBIT_PROFILE they expand to nothing and cost nothing.
+#ifdef ORBIT_PROFILE
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_THREAD(name) static thread_local bool PROFILE_CONCAT(profileThread, __LINE__) = profiler.NameThread(name); \
+  (void)PROFILE_CONCAT(profileThread, __LINE__)
+#else
+#define PROFILE_SCOPE(name)
+#define PROFILE_THREAD(name)
+#endif
+
+#endif
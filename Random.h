@@ -0,0 +1,33 @@
+#ifndef _RANDOM_H_
+#define _RANDOM_H_
+
+#include <cstdint>
+
+//SplitMix64 generator; the whole state is one integer so it can be saved in checkpoints
+class Random
+{
+public:
+  uint64_t state;
+
+  Random(uint64_t seed = 0) : state(seed) {}
+
+  uint64_t Next() { return Mix(state += 0x9E3779B97F4A7C15ULL); }
+
+  //Uniform in [0, 1)
+  double Uniform() { return (Next() >> 11) * (1.0 / 9007199254740992.0); }
+
+  //SplitMix64 finaliser, a bijective 64 bit hash
+  static uint64_t Mix(uint64_t z)
+  {
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+  }
+
+  //Counter based stream: the generator for item counter under key depends on nothing else, so items can be
+  //drawn on any thread in any order and still come out the same. The counter is hashed before it is mixed
+  //into the state, as neighbouring SplitMix states would give streams shifted by one draw.
+  static Random Stream(uint64_t key, uint64_t counter) { return Random(Mix(key ^ Mix(counter + 0x9E3779B97F4A7C15ULL))); }
+};
+
+#endif
@@ -0,0 +1,183 @@
+#include "Raster.h"
+#include <algorithm>
+#include <cmath>
+
+static const uint32_t BLACK = 0xFF000000;
+static const uint32_t WHITE = 0xFFFFFFFF;
+
+Raster::Raster() : width(0), height(0), splatted(false)
+{
+}
+
+void Raster::Resize(int w, int h)
+{
+  width = w;
+  height = h;
+  pixels.assign(static_cast<size_t>(w) * h, BLACK);
+  rowFull.assign(h, 0);
+  density.assign(static_cast<size_t>(w) * h, 0);
+  splatted = false;
+}
+
+void Raster::Clear()
+{
+  std::fill(pixels.begin(), pixels.end(), BLACK);
+  std::fill(rowFull.begin(), rowFull.end(), 0);
+}
+
+void Raster::Span(int y, int x0, int x1)
+{
+  if (y < 0 || y >= height || rowFull[y])
+    return;
+  x0 = std::max(x0, 0);
+  x1 = std::min(x1, width - 1);
+  if (x0 > x1)
+    return;
+  std::fill_n(pixels.begin() + static_cast<size_t>(y) * width + x0, x1 - x0 + 1, WHITE);
+  if (x0 == 0 && x1 == width - 1)
+    rowFull[y] = 1;
+}
+
+void Raster::FillDisc(double cx, double cy, double r)
+{
+  int y0 = std::max(static_cast<int>(ceil(cy - r)), 0);
+  int y1 = std::min(static_cast<int>(floor(cy + r)), height - 1);
+  for (int y = y0; y <= y1; y++)
+  {
+    double dy = y - cy;
+    double h = sqrt(std::max(r * r - dy * dy, 0.0));
+    Span(y, static_cast<int>(round(cx - h)), static_cast<int>(round(cx + h)) - 1);
+  }
+}
+
+void Raster::FillRect(int x, int y, int w, int h)
+{
+  int y0 = std::max(y, 0);
+  int y1 = std::min(y + h, height);
+  for (int row = y0; row < y1; row++)
+    Span(row, x, x + w - 1);
+}
+
+void Raster::Outline(int x, int y, int w, int h)
+{
+  FillRect(x, y, w, 1);
+  FillRect(x, y + h - 1, w, 1);
+  FillRect(x, y, 1, h);
+  FillRect(x + w - 1, y, 1, h);
+}
+
+void Raster::Plot(int x, int y, double intensity)
+{
+  if (x < 0 || x >= width || y < 0 || y >= height || rowFull[y])
+    return;
+  uint32_t level = static_cast<uint32_t>(intensity * 255 + 0.5);
+  uint32_t &p = pixels[static_cast<size_t>(y) * width + x];
+  if (level > (p & 0xFF))
+    p = BLACK | level * 0x010101;
+}
+
+void Raster::Line(double x0, double y0, double x1, double y1)
+{
+  //Liang-Barsky clip against the screen grown by a pixel, so the anti-aliased edge is kept
+  double dx = x1 - x0, dy = y1 - y0;
+  double t0 = 0, t1 = 1;
+  double p[4] = {-dx, dx, -dy, dy};
+  double q[4] = {x0 + 1, width - x0, y0 + 1, height - y0};
+  for (int k = 0; k < 4; k++)
+  {
+    if (p[k] == 0)
+    {
+      if (q[k] < 0)
+        return;
+      continue;
+    }
+    double t = q[k] / p[k];
+    if (p[k] < 0)
+      t0 = std::max(t0, t);
+    else
+      t1 = std::min(t1, t);
+  }
+  if (t0 > t1)
+    return;
+  double ax = x0 + t0 * dx, ay = y0 + t0 * dy;
+  double bx = x0 + t1 * dx, by = y0 + t1 * dy;
+
+  bool steep = fabs(by - ay) > fabs(bx - ax);
+  if (steep)
+  {
+    std::swap(ax, ay);
+    std::swap(bx, by);
+  }
+  if (ax > bx)
+  {
+    std::swap(ax, bx);
+    std::swap(ay, by);
+  }
+  double gradient = bx - ax == 0 ? 1 : (by - ay) / (bx - ax);
+  int xs = static_cast<int>(round(ax));
+  int xe = static_cast<int>(round(bx));
+  double y = ay + gradient * (xs - ax);
+  for (int x = xs; x <= xe; x++)
+  {
+    int yi = static_cast<int>(floor(y));
+    double f = y - yi;
+    if (steep)
+    {
+      Plot(yi, x, 1 - f);
+      Plot(yi + 1, x, f);
+    }
+    else
+    {
+      Plot(x, yi, 1 - f);
+      Plot(x, yi + 1, f);
+    }
+    y += gradient;
+  }
+}
+
+void Raster::Polyline(const double *x, const double *y, int n)
+{
+  if (n == 1)
+    Plot(static_cast<int>(x[0]), static_cast<int>(y[0]), 1);
+  for (int i = 0; i + 1 < n; i++)
+    Line(x[i], y[i], x[i + 1], y[i + 1]);
+}
+
+void Raster::Splat(double x, double y, float weight)
+{
+  double fx = x - 0.5, fy = y - 0.5;
+  int x0 = static_cast<int>(floor(fx));
+  int y0 = static_cast<int>(floor(fy));
+  if (x0 < -1 || x0 >= width || y0 < -1 || y0 >= height)
+    return;
+  float tx = static_cast<float>(fx - x0);
+  float ty = static_cast<float>(fy - y0);
+  float w[4] = {(1 - tx) * (1 - ty) * weight, tx * (1 - ty) * weight, (1 - tx) * ty * weight, tx * ty * weight};
+  for (int k = 0; k < 4; k++)
+  {
+    int px = x0 + (k & 1);
+    int py = y0 + (k >> 1);
+    if (px >= 0 && px < width && py >= 0 && py < height)
+      density[static_cast<size_t>(py) * width + px] += w[k];
+  }
+  splatted = true;
+}
+
+void Raster::ResolveSplats()
+{
+  if (!splatted)
+    return;
+  for (int y = 0; y < height; y++)
+  {
+    float *row = &density[static_cast<size_t>(y) * width];
+    for (int x = 0; x < width; x++)
+    {
+      if (row[x] > 0)
+      {
+        Plot(x, y, std::min(row[x], 1.0f));
+        row[x] = 0;
+      }
+    }
+  }
+  splatted = false;
+}
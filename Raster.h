@@ -0,0 +1,42 @@
+#ifndef _RASTER_H_
+#define _RASTER_H_
+
+#include <cstdint>
+#include <vector>
+
+//CPU framebuffer of 0xAARRGGBB pixels. Everything is drawn in shades of white, so blending is a per pixel max
+//and a row that has been filled edge to edge can skip every later span.
+class Raster
+{
+public:
+  int width, height;
+  std::vector<uint32_t> pixels;
+
+  Raster();
+
+  void Resize(int w, int h);
+  void Clear();
+  //Filled disc, rasterised as one horizontal span per row clipped to the screen
+  void FillDisc(double cx, double cy, double r);
+  void FillRect(int x, int y, int w, int h);
+  //One pixel wide rectangle border
+  void Outline(int x, int y, int w, int h);
+  //Anti-aliased line (Xiaolin Wu), clipped to the screen first so far off-screen points cost nothing
+  void Line(double x0, double y0, double x1, double y1);
+  //Polyline through n points given as separate x and y arrays
+  void Polyline(const double *x, const double *y, int n);
+  //Adds weight pixels of coverage at (x, y), spread bilinearly over the four nearest pixels
+  void Splat(double x, double y, float weight);
+  //Blends the accumulated splat coverage into the image, saturating at white, and resets it
+  void ResolveSplats();
+
+private:
+  std::vector<char> rowFull;
+  std::vector<float> density;
+  bool splatted;
+
+  void Span(int y, int x0, int x1);
+  void Plot(int x, int y, double intensity);
+};
+
+#endif
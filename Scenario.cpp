@@ -0,0 +1,588 @@
+#include "Scenario.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <fstream>
+#include <functional>
+
+static std::string Trim(const std::string &s)
+{
+  size_t a = s.find_first_not_of(" \t\r");
+  if (a == std::string::npos)
+    return "";
+  size_t b = s.find_last_not_of(" \t\r");
+  return s.substr(a, b - a + 1);
+}
+
+//Drops surrounding quotes from strings and brackets from arrays
+static std::string Unwrap(const std::string &s)
+{
+  if (s.size() >= 2 && ((s[0] == '"' && s.back() == '"') || (s[0] == '\'' && s.back() == '\'') || (s[0] == '[' && s.back() == ']')))
+    return Trim(s.substr(1, s.size() - 2));
+  return s;
+}
+
+static bool ParseNumbers(const std::string &text, std::vector<double> &out)
+{
+  out.clear();
+  const char *p = text.c_str();
+  while (true)
+  {
+    char *end;
+    double v = strtod(p, &end);
+    if (end == p)
+      return false;
+    out.push_back(v);
+    p = end;
+    while (*p == ' ' || *p == '\t')
+      p++;
+    if (*p == '\0')
+      return true;
+    if (*p != ',')
+      return false;
+    p++;
+  }
+}
+
+static bool ParseUnit(const std::string &text, const char *const names[], const double scales[], double &unit)
+{
+  for (int k = 0; names[k] != nullptr; k++)
+  {
+    if (text == names[k])
+    {
+      unit = scales[k];
+      return true;
+    }
+  }
+  std::vector<double> v;
+  if (!ParseNumbers(text, v) || v.size() != 1 || v[0] <= 0)
+    return false;
+  unit = v[0];
+  return true;
+}
+
+//Typed access to one section's values, reporting problems against the file and line
+class SectionReader
+{
+public:
+  SectionReader(const std::string &file, const ScenarioSection &section) : file(file), section(section), ok(true) {}
+
+  bool Has(const char *key) const { return section.values.count(key) > 0; }
+
+  std::vector<double> Numbers(const char *key, size_t count, const std::vector<double> &fallback)
+  {
+    std::map<std::string, std::string>::const_iterator it = section.values.find(key);
+    if (it == section.values.end())
+    {
+      if (fallback.empty())
+        Fail(key, "is required");
+      return fallback;
+    }
+    std::vector<double> v;
+    if (!ParseNumbers(it->second, v) || (v.size() != count && !(count == 2 && v.size() == 1)))
+    {
+      Fail(key, count == 3 ? "needs three numbers" : count == 2 ? "needs a number or a [from, to] range" : "needs a number");
+      return fallback.empty() ? std::vector<double>(count, 0) : fallback;
+    }
+    if (v.size() == 1 && count == 2)
+      v.push_back(v[0]);
+    return v;
+  }
+
+  double Number(const char *key, double fallback, bool required = false)
+  {
+    if (!Has(key))
+    {
+      if (required)
+        Fail(key, "is required");
+      return fallback;
+    }
+    return Numbers(key, 1, std::vector<double>(1, fallback))[0];
+  }
+
+  void Fail(const char *key, const char *message)
+  {
+    printf("%s:%d: [%s] %s %s\n", file.c_str(), section.line, section.name.c_str(), key, message);
+    ok = false;
+  }
+
+  const std::string &file;
+  const ScenarioSection &section;
+  bool ok;
+};
+
+static double Sample(const std::vector<double> &range, Random &rng)
+{
+  return range[0] + (range[1] - range[0]) * rng.Uniform();
+}
+
+//Bodies generated per task; large enough that the pool's scheduling cost is lost in the math
+static const int generateGrain = 4096;
+
+//Runs fill(first, end) over the count bodies appended at first, on pool when there is one
+static void Generate(Bodies &bodies, long count, ThreadPool *pool, const std::function<void(size_t, size_t)> &fill)
+{
+  size_t first = bodies.Append(count);
+  auto task = [&](int begin, int end, int) { fill(first + begin, first + end); };
+  if (pool != nullptr)
+    pool->ParallelFor(static_cast<int>(count), generateGrain, task);
+  else
+    task(0, static_cast<int>(count), 0);
+}
+
+Scenario::Scenario() : lengthUnit(1), massUnit(1), timeUnit(1)
+{
+}
+
+bool Scenario::Load(const std::string &file)
+{
+  std::ifstream in(file.c_str());
+  if (!in)
+  {
+    printf("Could not open scenario %s\n", file.c_str());
+    return false;
+  }
+  path = file;
+  sections.clear();
+  simulation.clear();
+  ScenarioSection top;
+  top.name = "simulation";
+  top.line = 0;
+  sections.push_back(top);
+
+  std::string text;
+  int number = 0;
+  while (std::getline(in, text))
+  {
+    number++;
+    //Cut comments, leaving any # inside quotes alone
+    bool quoted = false;
+    for (size_t i = 0; i < text.size(); i++)
+    {
+      if (text[i] == '"')
+        quoted = !quoted;
+      else if (text[i] == '#' && !quoted)
+      {
+        text.resize(i);
+        break;
+      }
+    }
+    std::string line = Trim(text);
+    if (line.empty())
+      continue;
+    if (line[0] == '[')
+    {
+      bool array = line.compare(0, 2, "[[") == 0;
+      size_t close = line.find(array ? "]]" : "]");
+      if (close == std::string::npos)
+      {
+        printf("%s:%d: unterminated section header\n", file.c_str(), number);
+        return false;
+      }
+      ScenarioSection section;
+      section.name = Trim(line.substr(array ? 2 : 1, close - (array ? 2 : 1)));
+      section.line = number;
+      sections.push_back(section);
+      continue;
+    }
+    size_t eq = line.find('=');
+    if (eq == std::string::npos)
+    {
+      printf("%s:%d: expected key = value\n", file.c_str(), number);
+      return false;
+    }
+    sections.back().values[Trim(line.substr(0, eq))] = Unwrap(Trim(line.substr(eq + 1)));
+  }
+
+  static const char *const lengthNames[] = {"m", "km", "au", "pc", nullptr};
+  static const double lengthScales[] = {1, 1e3, 1.495978707e11, 3.0856775814913673e16};
+  static const char *const massNames[] = {"kg", "msun", "mearth", nullptr};
+  static const double massScales[] = {1, 1.98847e30, 5.9722e24};
+  static const char *const timeNames[] = {"s", "day", "year", nullptr};
+  static const double timeScales[] = {1, 86400, 3.15576e7};
+  for (size_t k = 0; k < sections.size(); k++)
+  {
+    const ScenarioSection &s = sections[k];
+    if (s.name == "simulation")
+    {
+      for (std::map<std::string, std::string>::const_iterator it = s.values.begin(); it != s.values.end(); ++it)
+        simulation[it->first] = it->second;
+    }
+    else if (s.name == "units")
+    {
+      for (std::map<std::string, std::string>::const_iterator it = s.values.begin(); it != s.values.end(); ++it)
+      {
+        bool ok;
+        if (it->first == "length")
+          ok = ParseUnit(it->second, lengthNames, lengthScales, lengthUnit);
+        else if (it->first == "mass")
+          ok = ParseUnit(it->second, massNames, massScales, massUnit);
+        else if (it->first == "time")
+          ok = ParseUnit(it->second, timeNames, timeScales, timeUnit);
+        else
+          ok = false;
+        if (!ok)
+        {
+          printf("%s:%d: bad unit %s = %s\n", file.c_str(), s.line, it->first.c_str(), it->second.c_str());
+          return false;
+        }
+      }
+    }
+    else if (s.name != "body" && s.name != "ring" && s.name != "disk" && s.name != "plummer" && s.name != "file")
+    {
+      printf("%s:%d: unknown section [%s]\n", file.c_str(), s.line, s.name.c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+bool Scenario::Number(const std::string &key, double &value) const
+{
+  std::map<std::string, std::string>::const_iterator it = simulation.find(key);
+  std::vector<double> v;
+  if (it == simulation.end() || !ParseNumbers(it->second, v) || v.size() != 1)
+    return false;
+  value = v[0];
+  if (key == "dt")
+    value *= timeUnit;
+  else if (key == "softening" || key == "yukawa_lambda")
+    value *= lengthUnit;
+  return true;
+}
+
+bool Scenario::Build(Bodies &bodies, double G, Random &rng, ThreadPool *pool) const
+{
+  size_t first = bodies.size();
+  for (size_t k = 0; k < sections.size(); k++)
+  {
+    const ScenarioSection &s = sections[k];
+    bool ok = true;
+    if (s.name == "body")
+      ok = BuildBody(s, bodies);
+    else if (s.name == "ring" || s.name == "disk")
+      ok = BuildRing(s, bodies, G, rng.Next(), s.name == "disk", pool);
+    else if (s.name == "plummer")
+      ok = BuildPlummer(s, bodies, G, rng.Next(), pool);
+    else if (s.name == "file")
+      ok = BuildFile(s, bodies, pool);
+    if (!ok)
+      return false;
+  }
+  printf("Scenario %s: %zu bodies\n", path.c_str(), bodies.size() - first);
+  return true;
+}
+
+bool Scenario::BuildBody(const ScenarioSection &s, Bodies &bodies) const
+{
+  SectionReader r(path, s);
+  double m = r.Number("mass", 0, true);
+  std::vector<double> p = r.Numbers("position", 3, std::vector<double>(3, 0));
+  std::vector<double> v = r.Numbers("velocity", 3, std::vector<double>(3, 0));
+  if (!r.ok)
+    return false;
+  double vu = lengthUnit / timeUnit;
+  bodies.Add(m * massUnit, p[0] * lengthUnit, p[1] * lengthUnit, p[2] * lengthUnit, v[0] * vu, v[1] * vu, v[2] * vu);
+  return true;
+}
+
+//Rings and disks orbit a central body already in the scene, or a point mass given by center and central_mass.
+//Each orbiter gets the circular speed sqrt(G (M + m) / r) scaled by a sample of speed.
+bool Scenario::BuildRing(const ScenarioSection &s, Bodies &bodies, double G, uint64_t key, bool disk, ThreadPool *pool) const
+{
+  SectionReader r(path, s);
+  long count = static_cast<long>(r.Number("count", 0, true));
+  std::vector<double> radius = r.Numbers("radius", 2, std::vector<double>());
+  std::vector<double> mass = r.Numbers("mass", 2, std::vector<double>());
+  std::vector<double> speed = r.Numbers("speed", 2, std::vector<double>(2, 1));
+  std::vector<double> normal = r.Numbers("normal", 3, {0, 0, 1});
+  double thickness = r.Number("thickness", 0) * lengthUnit;
+  bool fixedAngle = r.Has("angle");
+  double degrees = r.Number("angle", 0);
+
+  double cm, cx, cy, cz, cvx, cvy, cvz;
+  if (r.Has("central"))
+  {
+    long c = static_cast<long>(r.Number("central", 0));
+    if (c < 0 || static_cast<size_t>(c) >= bodies.size())
+    {
+      r.Fail("central", "is not the index of a body defined earlier");
+      return false;
+    }
+    cm = bodies.mass[c];
+    cx = bodies.x[c];
+    cy = bodies.y[c];
+    cz = bodies.z[c];
+    cvx = bodies.vx[c];
+    cvy = bodies.vy[c];
+    cvz = bodies.vz[c];
+  }
+  else
+  {
+    std::vector<double> center = r.Numbers("center", 3, std::vector<double>(3, 0));
+    cm = r.Number("central_mass", 0, true) * massUnit;
+    cx = center[0] * lengthUnit;
+    cy = center[1] * lengthUnit;
+    cz = center[2] * lengthUnit;
+    cvx = cvy = cvz = 0;
+  }
+  double len = sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+  if (len == 0)
+    r.Fail("normal", "must not be zero");
+  if (count < 0)
+    r.Fail("count", "must not be negative");
+  if (!r.ok)
+    return false;
+
+  //Orthonormal basis (u, w) of the orbital plane; the default normal gives u = x and w = y
+  double nx = normal[0] / len, ny = normal[1] / len, nz = normal[2] / len;
+  double ax = 0, ay = 1, az = 0;
+  if (fabs(ny) > 0.9)
+  {
+    ax = 1;
+    ay = 0;
+  }
+  double ux = ay * nz - az * ny, uy = az * nx - ax * nz, uz = ax * ny - ay * nx;
+  double ul = sqrt(ux * ux + uy * uy + uz * uz);
+  ux /= ul;
+  uy /= ul;
+  uz /= ul;
+  double wx = ny * uz - nz * uy, wy = nz * ux - nx * uz, wz = nx * uy - ny * ux;
+
+  double c = 0, sn = 0;
+  bool axis = fixedAngle && fmod(degrees, 90) == 0;
+  if (axis)
+  {
+    //Exact axes, so arms laid along them get no stray 1e-16 components
+    static const double quarterCos[4] = {1, 0, -1, 0};
+    static const double quarterSin[4] = {0, 1, 0, -1};
+    int q = ((static_cast<int>(degrees / 90) % 4) + 4) % 4;
+    c = quarterCos[q];
+    sn = quarterSin[q];
+  }
+  size_t first = bodies.size();
+  Generate(bodies, count, pool, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++)
+    {
+      Random rng = Random::Stream(key, i - first);
+      double m = Sample(mass, rng) * massUnit;
+      double d;
+      if (disk)
+      {
+        //Uniform over the annulus area rather than in radius
+        double r0 = radius[0] * radius[0], r1 = radius[1] * radius[1];
+        d = sqrt(r0 + (r1 - r0) * rng.Uniform()) * lengthUnit;
+      }
+      else
+        d = Sample(radius, rng) * lengthUnit;
+      double v = sqrt(G * (cm + m) / d) * Sample(speed, rng);
+      double h = thickness > 0 ? (rng.Uniform() - 0.5) * thickness : 0;
+      double ci = c, si = sn;
+      if (!axis)
+      {
+        double a = fixedAngle ? degrees * M_PI / 180 : 2 * M_PI * rng.Uniform();
+        ci = cos(a);
+        si = sin(a);
+      }
+      bodies.mass[i] = m;
+      bodies.x[i] = cx + d * (ci * ux + si * wx) + h * nx;
+      bodies.y[i] = cy + d * (ci * uy + si * wy) + h * ny;
+      bodies.z[i] = cz + d * (ci * uz + si * wz) + h * nz;
+      bodies.vx[i] = cvx + v * (-si * ux + ci * wx);
+      bodies.vy[i] = cvy + v * (-si * uy + ci * wy);
+      bodies.vz[i] = cvz + v * (-si * uz + ci * wz);
+    }
+  });
+  return true;
+}
+
+//Isotropic random direction scaled to length
+static void RandomDirection(Random &rng, double length, double &x, double &y, double &z)
+{
+  double cz = 2 * rng.Uniform() - 1;
+  double phi = 2 * M_PI * rng.Uniform();
+  double sz = sqrt(1 - cz * cz);
+  x = length * sz * cos(phi);
+  y = length * sz * sin(phi);
+  z = length * cz;
+}
+
+//Aarseth, Henon and Wielen (1974) sampling of a Plummer sphere of equal mass bodies
+bool Scenario::BuildPlummer(const ScenarioSection &s, Bodies &bodies, double G, uint64_t key, ThreadPool *pool) const
+{
+  SectionReader r(path, s);
+  long count = static_cast<long>(r.Number("count", 0, true));
+  double total = r.Number("mass", 0, true) * massUnit;
+  double scale = r.Number("scale", 0, true) * lengthUnit;
+  std::vector<double> center = r.Numbers("center", 3, std::vector<double>(3, 0));
+  std::vector<double> velocity = r.Numbers("velocity", 3, std::vector<double>(3, 0));
+  if (count <= 0 || scale <= 0)
+    r.Fail("count and scale", "must be positive");
+  if (!r.ok)
+    return false;
+
+  double vu = lengthUnit / timeUnit;
+  double m = total / count;
+  double ox = center[0] * lengthUnit, oy = center[1] * lengthUnit, oz = center[2] * lengthUnit;
+  double ovx = velocity[0] * vu, ovy = velocity[1] * vu, ovz = velocity[2] * vu;
+  size_t first = bodies.size();
+  Generate(bodies, count, pool, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++)
+    {
+      Random rng = Random::Stream(key, i - first);
+      //Cut the rare far outliers, as is usual, so one body does not set the octree's extent
+      double radius;
+      do
+      {
+        //U^(-2/3) - 1, with cbrt and sqrt in place of pow here and below as pow dominates the cost
+        double u = rng.Uniform();
+        radius = scale / sqrt(1 / cbrt(u * u) - 1);
+      } while (!(radius < 10 * scale));
+      double x, y, z;
+      RandomDirection(rng, radius, x, y, z);
+
+      //Speed as a fraction q of the local escape speed, by rejection from g(q) = q^2 (1 - q^2)^3.5
+      double q, g, t;
+      do
+      {
+        q = rng.Uniform();
+        g = 0.1 * rng.Uniform();
+        t = 1 - q * q;
+      } while (g > q * q * t * t * t * sqrt(t));
+      double escape = sqrt(2 * G * total / sqrt(radius * radius + scale * scale));
+      double vx, vy, vz;
+      RandomDirection(rng, q * escape, vx, vy, vz);
+
+      bodies.mass[i] = m;
+      bodies.x[i] = ox + x;
+      bodies.y[i] = oy + y;
+      bodies.z[i] = oz + z;
+      bodies.vx[i] = ovx + vx;
+      bodies.vy[i] = ovy + vy;
+      bodies.vz[i] = ovz + vz;
+    }
+  });
+  return true;
+}
+
+//Start of the line containing pos
+static size_t LineStart(const std::vector<char> &text, size_t pos)
+{
+  while (pos > 0 && text[pos - 1] != '\n')
+    pos--;
+  return pos;
+}
+
+//Bulk bodies, one "mass,x,y,z,vx,vy,vz" line each. The file is read in one go, cut into line-aligned chunks
+//and every chunk is parsed on its own worker; chunks are appended in file order so ids follow the file.
+bool Scenario::BuildFile(const ScenarioSection &s, Bodies &bodies, ThreadPool *pool) const
+{
+  SectionReader r(path, s);
+  std::map<std::string, std::string>::const_iterator it = s.values.find("path");
+  if (it == s.values.end())
+  {
+    r.Fail("path", "is required");
+    return false;
+  }
+  //Relative paths are taken from the scenario's directory
+  std::string file = it->second;
+  size_t slash = path.find_last_of("/\\");
+  if (!file.empty() && file[0] != '/' && slash != std::string::npos)
+    file = path.substr(0, slash + 1) + file;
+
+  FILE *in = fopen(file.c_str(), "rb");
+  if (in == nullptr)
+  {
+    printf("Could not open %s\n", file.c_str());
+    return false;
+  }
+  fseek(in, 0, SEEK_END);
+  long size = ftell(in);
+  fseek(in, 0, SEEK_SET);
+  std::vector<char> text(size + 1);
+  bool read = size <= 0 || fread(text.data(), 1, size, in) == static_cast<size_t>(size);
+  fclose(in);
+  if (!read)
+  {
+    printf("Could not read %s\n", file.c_str());
+    return false;
+  }
+  text[size] = '\0';
+
+  int chunks = pool != nullptr ? pool->Size() * 4 : 1;
+  chunks = std::max(1, std::min<int>(chunks, size / 65536 + 1));
+  std::vector<std::vector<double>> parsed(chunks);
+  std::vector<long> bad(chunks, 0);
+  auto parse = [&](int begin, int end, int) {
+    for (int c = begin; c < end; c++)
+    {
+      size_t from = LineStart(text, static_cast<size_t>(size) * c / chunks);
+      size_t to = LineStart(text, static_cast<size_t>(size) * (c + 1) / chunks);
+      if (c == chunks - 1)
+        to = size;
+      std::vector<double> &out = parsed[c];
+      out.reserve((to - from) / 40 * 7);
+      const char *p = text.data() + from;
+      const char *stop = text.data() + to;
+      while (p < stop)
+      {
+        const char *eol = static_cast<const char *>(memchr(p, '\n', stop - p));
+        if (eol == nullptr)
+          eol = stop;
+        while (p < eol && (*p == ' ' || *p == '\t' || *p == '\r'))
+          p++;
+        //Blank lines, comments and a header row are skipped
+        if (p < eol && *p != '#' && !isalpha(static_cast<unsigned char>(*p)))
+        {
+          double v[7];
+          int k = 0;
+          for (; k < 7; k++)
+          {
+            char *end;
+            v[k] = strtod(p, &end);
+            if (end == p || end > eol)
+              break;
+            p = end;
+            while (p < eol && (*p == ',' || *p == ' ' || *p == '\t'))
+              p++;
+          }
+          if (k == 7)
+            out.insert(out.end(), v, v + 7);
+          else
+            bad[c]++;
+        }
+        p = eol + 1;
+      }
+    }
+  };
+  if (pool != nullptr)
+    pool->ParallelFor(chunks, 1, parse);
+  else
+    parse(0, chunks, 0);
+
+  long malformed = 0;
+  size_t total = 0;
+  for (int c = 0; c < chunks; c++)
+  {
+    malformed += bad[c];
+    total += parsed[c].size() / 7;
+  }
+  if (malformed > 0)
+  {
+    printf("%s: %ld lines are not mass,x,y,z,vx,vy,vz\n", file.c_str(), malformed);
+    return false;
+  }
+  double vu = lengthUnit / timeUnit;
+  bodies.Reserve(bodies.size() + total);
+  for (int c = 0; c < chunks; c++)
+  {
+    const std::vector<double> &v = parsed[c];
+    for (size_t i = 0; i < v.size(); i += 7)
+      bodies.Add(v[i] * massUnit, v[i + 1] * lengthUnit, v[i + 2] * lengthUnit, v[i + 3] * lengthUnit,
+                 v[i + 4] * vu, v[i + 5] * vu, v[i + 6] * vu);
+  }
+  return true;
+}
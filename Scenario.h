@@ -0,0 +1,58 @@
+#ifndef _SCENARIO_H_
+#define _SCENARIO_H_
+
+#include "Bodies.h"
+#include "Random.h"
+#include "ThreadPool.h"
+#include <map>
+#include <string>
+#include <vector>
+
+//One [section] or [[section]] of a scenario file
+struct ScenarioSection
+{
+  std::string name;
+  std::map<std::string, std::string> values;
+  int line;
+};
+
+//Scene description read from a small TOML subset instead of being compiled into Setup():
+//  [simulation]  G, dt or rate, integrator, solver, theta, fmm_order, seed, tolerance, eta,
+//                force_law, softening, yukawa_alpha, yukawa_lambda
+//  [units]       length, mass, time: size of one file unit in simulation units (a number, or m/km/au/pc,
+//                kg/msun/mearth, s/day/year), applied to every body and generator value and to dt, softening and
+//                yukawa_lambda. G and the other [simulation] settings are always in simulation units
+//  [[body]]      mass, position, velocity
+//  [[ring]]      count, central, radius, mass, speed, angle, normal: orbiters on circular orbits around a body
+//  [[disk]]      count, central, radius, mass, speed, thickness: orbiters spread evenly over an annulus
+//  [[plummer]]   count, mass, scale, center, velocity: Plummer sphere in virial equilibrium
+//  [[file]]      path: bulk CSV of mass,x,y,z,vx,vy,vz lines, parsed in parallel
+//Two-number values such as radius = [375, 275] are ranges, sampled as a + (b - a) * U with U uniform in [0, 1).
+class Scenario
+{
+public:
+  std::string path;
+  double lengthUnit, massUnit, timeUnit;
+  std::map<std::string, std::string> simulation;
+
+  Scenario();
+
+  bool Load(const std::string &file);
+  bool Loaded() const { return !path.empty(); }
+  //Appends the scenario's bodies in file order. Each generator section takes one key from rng and gives body i
+  //the counter stream (key, i), so the scene depends on the seed alone and not on how many threads pool has.
+  bool Build(Bodies &bodies, double G, Random &rng, ThreadPool *pool) const;
+
+  //Value of a [simulation] key, with dt and lengths converted to simulation units; false if the key is missing or malformed
+  bool Number(const std::string &key, double &value) const;
+
+private:
+  std::vector<ScenarioSection> sections;
+
+  bool BuildBody(const ScenarioSection &s, Bodies &bodies) const;
+  bool BuildRing(const ScenarioSection &s, Bodies &bodies, double G, uint64_t key, bool disk, ThreadPool *pool) const;
+  bool BuildPlummer(const ScenarioSection &s, Bodies &bodies, double G, uint64_t key, ThreadPool *pool) const;
+  bool BuildFile(const ScenarioSection &s, Bodies &bodies, ThreadPool *pool) const;
+};
+
+#endif
@@ -0,0 +1,120 @@
+#include "SimThread.h"
+#include <chrono>
+
+SimThread::SimThread() : stepsPerSecond(0), stepsPerFrame(0), running(false), stopping(false), budget(0)
+{
+}
+
+SimThread::~SimThread()
+{
+  Stop();
+}
+
+void SimThread::Start(std::function<void()> step, std::function<void(SimFrame &)> publish)
+{
+  stepFn = step;
+  publishFn = publish;
+  stopping = false;
+  //Publish the initial state so the first rendered frame has something to show
+  publishFn(buffer.Back());
+  buffer.Publish();
+  thread = std::thread(&SimThread::Loop, this);
+}
+
+void SimThread::Stop()
+{
+  if (!thread.joinable())
+    return;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  wake.notify_all();
+  thread.join();
+}
+
+void SimThread::Post(const Command &command)
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    commands.push_back(command);
+  }
+  wake.notify_all();
+}
+
+void SimThread::SetRunning(bool value)
+{
+  running = value;
+  wake.notify_all();
+}
+
+void SimThread::FrameTick()
+{
+  if (stepsPerFrame <= 0)
+    return;
+  //Cap the backlog so a stall does not turn into a burst of catch-up steps
+  int limit = 4 * stepsPerFrame;
+  int current = budget.load();
+  int next;
+  do
+  {
+    next = current + stepsPerFrame < limit ? current + stepsPerFrame : limit;
+  } while (!budget.compare_exchange_weak(current, next));
+  wake.notify_all();
+}
+
+void SimThread::Loop()
+{
+  typedef std::chrono::steady_clock Clock;
+  Clock::time_point deadline = Clock::now();
+  std::vector<Command> pending;
+  while (true)
+  {
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      pending.swap(commands);
+      if (stopping)
+        return;
+    }
+    bool changed = !pending.empty();
+    for (size_t i = 0; i < pending.size(); i++)
+      pending[i]();
+    pending.clear();
+
+    bool canStep = running.load();
+    if (canStep && stepsPerFrame > 0)
+    {
+      int current = budget.load();
+      canStep = false;
+      while (current > 0 && !(canStep = budget.compare_exchange_weak(current, current - 1)))
+      {
+      }
+    }
+    if (canStep)
+    {
+      stepFn();
+      changed = true;
+    }
+    if (changed)
+    {
+      publishFn(buffer.Back());
+      buffer.Publish();
+    }
+
+    std::unique_lock<std::mutex> guard(lock);
+    if (!canStep)
+    {
+      //Idle until a command, a frame tick or a run toggle arrives
+      wake.wait_for(guard, std::chrono::milliseconds(5));
+      deadline = Clock::now();
+    }
+    else if (stepsPerFrame <= 0 && stepsPerSecond > 0)
+    {
+      deadline += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1 / stepsPerSecond));
+      Clock::time_point now = Clock::now();
+      if (now - deadline > std::chrono::milliseconds(250))
+        deadline = now;
+      wake.wait_until(guard, deadline, [this] { return stopping.load() || !commands.empty(); });
+    }
+  }
+}
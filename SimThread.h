@@ -0,0 +1,91 @@
+#ifndef _SIMTHREAD_H_
+#define _SIMTHREAD_H_
+
+#include "Bodies.h"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//Everything the renderer needs from one simulation step
+struct SimFrame
+{
+  AlignedDoubles mass, x, y, z;
+  std::vector<uint64_t> id;
+  std::vector<double> trail;    //Packed x, y, z of every trail, oldest point first
+  std::vector<int> trailStarts; //First point of each trail in trail, plus the total point count
+  int follow;                //Index of the followed body, -1 for none
+  long step;
+  double time;
+
+  SimFrame() : follow(-1), step(0), time(0) {}
+};
+
+//Lock-free triple buffer: the writer always has a free back buffer and the reader always has a stable front one
+class TripleBuffer
+{
+private:
+  SimFrame frames[3];
+  std::atomic<int> middle; //Index of the middle buffer, bit 2 set when it holds an unread frame
+  int back, front;
+
+public:
+  TripleBuffer() : middle(1), back(0), front(2) {}
+
+  SimFrame &Back() { return frames[back]; }
+  void Publish() { back = middle.exchange(back | 4) & 3; }
+
+  //Swaps in the newest published frame; returns false if nothing new arrived
+  bool Acquire()
+  {
+    if ((middle.load() & 4) == 0)
+      return false;
+    front = middle.exchange(front) & 3;
+    return true;
+  }
+  const SimFrame &Front() const { return frames[front]; }
+};
+
+//Runs the integrator on its own thread and hands state to the renderer through a triple buffer.
+//All changes to simulation state are posted as commands and run on the simulation thread between steps.
+class SimThread
+{
+public:
+  typedef std::function<void()> Command;
+
+  double stepsPerSecond; //Wall-clock pacing, 0 runs flat out
+  int stepsPerFrame;     //When positive, each FrameTick() allows this many more steps instead
+
+  SimThread();
+  ~SimThread();
+
+  //step advances the simulation once, publish fills a frame from the current state
+  void Start(std::function<void()> step, std::function<void(SimFrame &)> publish);
+  void Stop();
+
+  void Post(const Command &command);
+  void SetRunning(bool value);
+  bool Running() const { return running.load(); }
+  void FrameTick();
+
+  bool Acquire() { return buffer.Acquire(); }
+  const SimFrame &Front() const { return buffer.Front(); }
+
+private:
+  TripleBuffer buffer;
+  std::thread thread;
+  std::mutex lock;
+  std::condition_variable wake;
+  std::vector<Command> commands;
+  std::atomic<bool> running;
+  std::atomic<bool> stopping;
+  std::atomic<int> budget;
+  std::function<void()> stepFn;
+  std::function<void(SimFrame &)> publishFn;
+
+  void Loop();
+};
+
+#endif
@@ -0,0 +1,229 @@
+#include "Snapshot.h"
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char SNAPSHOT_MAGIC[8] = {'O', 'R', 'B', 'S', 'N', 'A', 'P', 0};
+static const uint32_t SNAPSHOT_VERSION = 1;
+
+static uint64_t ColumnStride(uint64_t count)
+{
+  uint64_t bytes = count * 8;
+  return (bytes + 63) & ~static_cast<uint64_t>(63);
+}
+
+bool WriteSnapshotCsv(const std::string &path, const Bodies &bodies, long step, double time)
+{
+  FILE *file = fopen(path.c_str(), "w");
+  if (file == nullptr)
+  {
+    printf("Could not write snapshot %s\n", path.c_str());
+    return false;
+  }
+  fprintf(file, "# step %ld time %.17g bodies %zu\n", step, time, bodies.size());
+  fprintf(file, "id,mass,x,y,z,vx,vy,vz\n");
+  for (size_t i = 0; i < bodies.size(); i++)
+  {
+    fprintf(file, "%llu,%.17g,%.17g,%.17g,%.17g,%.17g,%.17g,%.17g\n",
+            static_cast<unsigned long long>(bodies.id[i]), bodies.mass[i],
+            bodies.x[i], bodies.y[i], bodies.z[i],
+            bodies.vx[i], bodies.vy[i], bodies.vz[i]);
+  }
+  bool ok = ferror(file) == 0;
+  fclose(file);
+  return ok;
+}
+
+bool WriteSnapshotBinary(const std::string &path, const Bodies &bodies, const SnapshotInfo &info)
+{
+  std::string temp = path + ".tmp";
+  FILE *file = fopen(temp.c_str(), "wb");
+  if (file == nullptr)
+  {
+    printf("Could not write snapshot %s\n", temp.c_str());
+    return false;
+  }
+
+  uint64_t count = bodies.size();
+  SnapshotHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+  header.version = SNAPSHOT_VERSION;
+  header.headerSize = sizeof(SnapshotHeader);
+  header.count = count;
+  header.step = info.step;
+  header.time = info.time;
+  header.rate = info.rate;
+  header.rngState = info.rngState;
+  header.nextId = bodies.NextId();
+  header.columnStride = ColumnStride(count);
+  fwrite(&header, sizeof(header), 1, file);
+
+  static const char padding[64] = {0};
+  size_t pad = header.columnStride - count * 8;
+  const void *columns[COLUMN_COUNT] = {bodies.id.data(), bodies.mass.data(),
+                                       bodies.x.data(), bodies.y.data(), bodies.z.data(),
+                                       bodies.vx.data(), bodies.vy.data(), bodies.vz.data()};
+  for (int c = 0; c < COLUMN_COUNT; c++)
+  {
+    fwrite(columns[c], 8, count, file);
+    fwrite(padding, 1, pad, file);
+  }
+
+  bool ok = ferror(file) == 0;
+  ok = fclose(file) == 0 && ok;
+  if (!ok)
+  {
+    remove(temp.c_str());
+    printf("Could not write snapshot %s\n", path.c_str());
+    return false;
+  }
+#ifdef _WIN32
+  remove(path.c_str());
+#endif
+  if (rename(temp.c_str(), path.c_str()) != 0)
+  {
+    printf("Could not replace snapshot %s\n", path.c_str());
+    return false;
+  }
+  return true;
+}
+
+MappedSnapshot::MappedSnapshot() : data(nullptr), size(0)
+{
+#ifdef _WIN32
+  file = INVALID_HANDLE_VALUE;
+  mapping = nullptr;
+#endif
+}
+
+MappedSnapshot::~MappedSnapshot()
+{
+  Close();
+}
+
+bool MappedSnapshot::Open(const std::string &path)
+{
+  Close();
+#ifdef _WIN32
+  file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+  {
+    printf("Could not open snapshot %s\n", path.c_str());
+    return false;
+  }
+  LARGE_INTEGER length;
+  GetFileSizeEx(file, &length);
+  size = static_cast<size_t>(length.QuadPart);
+  mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mapping != nullptr)
+    data = static_cast<const unsigned char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    printf("Could not open snapshot %s\n", path.c_str());
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == 0 && st.st_size > 0)
+  {
+    size = st.st_size;
+    void *p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p != MAP_FAILED)
+    {
+      data = static_cast<const unsigned char *>(p);
+      //Columns are read front to back once
+      madvise(p, size, MADV_SEQUENTIAL);
+    }
+  }
+  close(fd);
+#endif
+  if (data == nullptr)
+  {
+    printf("Could not map snapshot %s\n", path.c_str());
+    Close();
+    return false;
+  }
+
+  const SnapshotHeader &header = Header();
+  if (size < sizeof(SnapshotHeader) || memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0)
+  {
+    printf("%s is not a snapshot\n", path.c_str());
+    Close();
+    return false;
+  }
+  if (header.version != SNAPSHOT_VERSION || header.headerSize < sizeof(SnapshotHeader))
+  {
+    printf("Unsupported snapshot version %u in %s\n", header.version, path.c_str());
+    Close();
+    return false;
+  }
+  //The header comes from the file, so bound each field by the file size before multiplying
+  size_t body = size > header.headerSize ? size - header.headerSize : 0;
+  if (header.headerSize % 8 != 0 || header.columnStride % 8 != 0 || header.count > body / 8 ||
+      header.columnStride > body / COLUMN_COUNT || header.columnStride < header.count * 8)
+  {
+    printf("Snapshot %s is truncated\n", path.c_str());
+    Close();
+    return false;
+  }
+  return true;
+}
+
+void MappedSnapshot::Close()
+{
+#ifdef _WIN32
+  if (data != nullptr)
+    UnmapViewOfFile(data);
+  if (mapping != nullptr)
+    CloseHandle(mapping);
+  if (file != INVALID_HANDLE_VALUE)
+    CloseHandle(file);
+  mapping = nullptr;
+  file = INVALID_HANDLE_VALUE;
+#else
+  if (data != nullptr)
+    munmap(const_cast<unsigned char *>(data), size);
+#endif
+  data = nullptr;
+  size = 0;
+}
+
+SnapshotInfo MappedSnapshot::Info() const
+{
+  SnapshotInfo info;
+  info.step = Header().step;
+  info.time = Header().time;
+  info.rate = Header().rate;
+  info.rngState = Header().rngState;
+  return info;
+}
+
+bool LoadSnapshot(const std::string &path, Bodies &bodies, SnapshotInfo &info)
+{
+  MappedSnapshot snapshot;
+  if (!snapshot.Open(path))
+    return false;
+  bodies.Assign(snapshot.Count(), snapshot.Ids(), snapshot.Doubles(COLUMN_MASS),
+                snapshot.Doubles(COLUMN_X), snapshot.Doubles(COLUMN_Y), snapshot.Doubles(COLUMN_Z),
+                snapshot.Doubles(COLUMN_VX), snapshot.Doubles(COLUMN_VY), snapshot.Doubles(COLUMN_VZ),
+                snapshot.Header().nextId);
+  info = snapshot.Info();
+  return true;
+}
+
+std::string SnapshotPath(const std::string &prefix, long step, const char *extension)
+{
+  char number[32];
+  snprintf(number, sizeof(number), "_%08ld.", step);
+  return prefix + number + extension;
+}
@@ -0,0 +1,86 @@
+#ifndef _SNAPSHOT_H_
+#define _SNAPSHOT_H_
+
+#include "Bodies.h"
+#include <string>
+
+//Simulation state stored next to the bodies in a binary snapshot
+struct SnapshotInfo
+{
+  long step;
+  double time;
+  double rate; //Time step is 2^rate
+  uint64_t rngState;
+};
+
+//Binary snapshot layout, version 1, native little-endian:
+//a 128 byte header followed by the id, mass, x, y, z, vx, vy, vz columns,
+//each starting on a 64 byte boundary so a mapped file can be read in place.
+struct SnapshotHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t headerSize;
+  uint64_t count;
+  int64_t step;
+  double time;
+  double rate;
+  uint64_t rngState;
+  uint64_t nextId;
+  uint64_t columnStride; //Bytes from the start of one column to the next
+  uint64_t reserved[7];
+};
+
+static_assert(sizeof(SnapshotHeader) == 128, "snapshot header must keep the columns 64 byte aligned");
+
+enum SnapshotColumn
+{
+  COLUMN_ID,
+  COLUMN_MASS,
+  COLUMN_X,
+  COLUMN_Y,
+  COLUMN_Z,
+  COLUMN_VX,
+  COLUMN_VY,
+  COLUMN_VZ,
+  COLUMN_COUNT
+};
+
+//Plain text snapshot: a header line with the step and simulated time, then one body per line
+bool WriteSnapshotCsv(const std::string &path, const Bodies &bodies, long step, double time);
+
+//Writes to a temporary file and renames it over path, so a crash never leaves a torn checkpoint
+bool WriteSnapshotBinary(const std::string &path, const Bodies &bodies, const SnapshotInfo &info);
+
+//Read-only memory mapped view of a binary snapshot; the column pointers point straight into the mapping
+class MappedSnapshot
+{
+private:
+  const unsigned char *data;
+  size_t size;
+#ifdef _WIN32
+  void *file;
+  void *mapping;
+#endif
+
+public:
+  MappedSnapshot();
+  ~MappedSnapshot();
+
+  bool Open(const std::string &path);
+  void Close();
+
+  const SnapshotHeader &Header() const { return *reinterpret_cast<const SnapshotHeader *>(data); }
+  size_t Count() const { return Header().count; }
+  const void *Column(SnapshotColumn column) const { return data + Header().headerSize + column * Header().columnStride; }
+  const double *Doubles(SnapshotColumn column) const { return static_cast<const double *>(Column(column)); }
+  const uint64_t *Ids() const { return static_cast<const uint64_t *>(Column(COLUMN_ID)); }
+  SnapshotInfo Info() const;
+};
+
+//Maps the file and copies the columns into bodies
+bool LoadSnapshot(const std::string &path, Bodies &bodies, SnapshotInfo &info);
+
+std::string SnapshotPath(const std::string &prefix, long step, const char *extension);
+
+#endif
@@ -0,0 +1,143 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool() : job(nullptr), remaining(0), generation(0), stopping(false)
+{
+  queues.push_back(new Queue());
+}
+
+ThreadPool::~ThreadPool()
+{
+  Stop();
+  for (size_t i = 0; i < queues.size(); i++)
+    delete queues[i];
+}
+
+void ThreadPool::Stop()
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (size_t i = 0; i < workers.size(); i++)
+    workers[i].join();
+  workers.clear();
+  stopping = false;
+}
+
+void ThreadPool::Resize(int threads)
+{
+  if (threads <= 0)
+    threads = std::thread::hardware_concurrency();
+  if (threads <= 0)
+    threads = 1;
+  Stop();
+  for (size_t i = 0; i < queues.size(); i++)
+    delete queues[i];
+  queues.clear();
+  for (int i = 0; i < threads; i++)
+    queues.push_back(new Queue());
+  for (int i = 1; i < threads; i++)
+    workers.push_back(std::thread(&ThreadPool::WorkerLoop, this, i));
+}
+
+void ThreadPool::ParallelFor(int n, int grain, const Task &fn)
+{
+  if (n <= 0)
+    return;
+  if (grain < 1)
+    grain = 1;
+  int chunks = (n + grain - 1) / grain;
+  if (workers.empty() || chunks == 1)
+  {
+    fn(0, n, 0);
+    return;
+  }
+
+  //Publish the job before any chunk becomes visible to a worker
+  remaining = chunks;
+  job = &fn;
+  int count = queues.size();
+  for (int q = 0; q < count; q++)
+  {
+    //Each worker starts on its own contiguous block of chunks
+    int first = static_cast<long long>(chunks) * q / count;
+    int last = static_cast<long long>(chunks) * (q + 1) / count;
+    std::lock_guard<std::mutex> guard(queues[q]->lock);
+    for (int c = first; c < last; c++)
+    {
+      Range range;
+      range.begin = c * grain;
+      range.end = std::min(n, range.begin + grain);
+      queues[q]->ranges.push_back(range);
+    }
+  }
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    generation++;
+  }
+  wake.notify_all();
+
+  Work(0);
+
+  std::unique_lock<std::mutex> guard(lock);
+  done.wait(guard, [this] { return remaining.load() == 0; });
+}
+
+void ThreadPool::WorkerLoop(int index)
+{
+  unsigned long seen = 0;
+  while (true)
+  {
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      wake.wait(guard, [&] { return stopping || generation != seen; });
+      if (stopping)
+        return;
+      seen = generation;
+    }
+    Work(index);
+  }
+}
+
+void ThreadPool::Work(int index)
+{
+  Range range;
+  while (remaining.load() > 0 && (Pop(index, range) || Steal(index, range)))
+  {
+    (*job.load())(range.begin, range.end, index);
+    if (--remaining == 0)
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      done.notify_all();
+    }
+  }
+}
+
+bool ThreadPool::Pop(int index, Range &range)
+{
+  Queue *queue = queues[index];
+  std::lock_guard<std::mutex> guard(queue->lock);
+  if (queue->ranges.empty())
+    return false;
+  range = queue->ranges.front();
+  queue->ranges.pop_front();
+  return true;
+}
+
+bool ThreadPool::Steal(int index, Range &range)
+{
+  int count = queues.size();
+  for (int k = 1; k < count; k++)
+  {
+    Queue *queue = queues[(index + k) % count];
+    std::lock_guard<std::mutex> guard(queue->lock);
+    if (queue->ranges.empty())
+      continue;
+    range = queue->ranges.back();
+    queue->ranges.pop_back();
+    return true;
+  }
+  return false;
+}
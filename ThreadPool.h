@@ -0,0 +1,56 @@
+#ifndef _THREADPOOL_H_
+#define _THREADPOOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//Persistent worker pool; each worker owns a deque of index ranges and steals from the others once it runs dry
+class ThreadPool
+{
+public:
+  typedef std::function<void(int begin, int end, int worker)> Task;
+
+  ThreadPool();
+  ~ThreadPool();
+
+  void Resize(int threads);
+  int Size() const { return queues.size(); }
+
+  //Runs fn over [0, n) in chunks of grain indices and returns once every chunk is done.
+  //The calling thread takes part as worker 0.
+  void ParallelFor(int n, int grain, const Task &fn);
+
+private:
+  struct Range
+  {
+    int begin, end;
+  };
+  struct Queue
+  {
+    std::mutex lock;
+    std::deque<Range> ranges;
+  };
+
+  std::vector<std::thread> workers;
+  std::vector<Queue *> queues;
+  std::atomic<const Task *> job;
+  std::atomic<int> remaining;
+  std::mutex lock;
+  std::condition_variable wake;
+  std::condition_variable done;
+  unsigned long generation;
+  bool stopping;
+
+  void Stop();
+  void WorkerLoop(int index);
+  void Work(int index);
+  bool Pop(int index, Range &range);
+  bool Steal(int index, Range &range);
+};
+
+#endif
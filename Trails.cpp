@@ -0,0 +1,153 @@
+#include "Trails.h"
+#include <algorithm>
+
+TrailRing::TrailRing(uint64_t bodyId, size_t capacity, int decimation) : id(bodyId), decimation(std::max(decimation, 1)),
+                                                                           capacity(0), head(0), count(0), skipped(0), hint(0)
+{
+  Resize(capacity);
+}
+
+void TrailRing::Push(double x, double y, double z)
+{
+  if (capacity == 0)
+    return;
+  if (skipped > 0)
+  {
+    skipped = (skipped + 1) % decimation;
+    return;
+  }
+  skipped = (skipped + 1) % decimation;
+  //The ring grows as points arrive and only wraps once it holds capacity points
+  if (points.size() < capacity * 3)
+  {
+    points.push_back(x);
+    points.push_back(y);
+    points.push_back(z);
+  }
+  else
+  {
+    double *p = &points[head * 3];
+    p[0] = x;
+    p[1] = y;
+    p[2] = z;
+  }
+  head = head + 1 == capacity ? 0 : head + 1;
+  if (count < capacity)
+    count++;
+}
+
+void TrailRing::Resize(size_t newCapacity)
+{
+  if (newCapacity == capacity)
+    return;
+  capacity = newCapacity;
+  Clear();
+  std::vector<double>().swap(points);
+}
+
+void TrailRing::Clear()
+{
+  points.clear();
+  head = 0;
+  count = 0;
+  skipped = 0;
+}
+
+void TrailRing::CopyTo(std::vector<double> &out) const
+{
+  //The oldest point sits at head once the ring has wrapped, at zero before that
+  size_t first = count < capacity ? 0 : head;
+  size_t tail = std::min(count, capacity - first);
+  out.insert(out.end(), points.begin() + first * 3, points.begin() + (first + tail) * 3);
+  out.insert(out.end(), points.begin(), points.begin() + (count - tail) * 3);
+}
+
+long Trails::Find(uint64_t id) const
+{
+  for (size_t k = 0; k < rings.size(); k++)
+  {
+    if (rings[k].id == id)
+      return static_cast<long>(k);
+  }
+  return -1;
+}
+
+bool Trails::Track(uint64_t id, size_t capacity, int decimation)
+{
+  long k = Find(id);
+  if (k >= 0)
+  {
+    TrailRing &ring = rings[k];
+    decimation = std::max(decimation, 1);
+    if (ring.decimation != decimation)
+    {
+      ring.decimation = decimation;
+      ring.Clear();
+    }
+    ring.Resize(capacity);
+    return false;
+  }
+  rings.push_back(TrailRing(id, capacity, decimation));
+  return true;
+}
+
+void Trails::Untrack(uint64_t id)
+{
+  long k = Find(id);
+  if (k >= 0)
+    rings.erase(rings.begin() + k);
+}
+
+bool Trails::Tracked(uint64_t id) const
+{
+  return Find(id) >= 0;
+}
+
+void Trails::Clear()
+{
+  rings.clear();
+}
+
+void Trails::ClearPoints()
+{
+  for (size_t k = 0; k < rings.size(); k++)
+    rings[k].Clear();
+}
+
+void Trails::Record(const Bodies &bodies)
+{
+  size_t out = 0;
+  for (size_t k = 0; k < rings.size(); k++)
+  {
+    TrailRing &ring = rings[k];
+    //Compaction only ever moves a body towards the front, so the old index is usually still right
+    if (ring.hint >= bodies.size() || bodies.id[ring.hint] != ring.id)
+    {
+      long i = bodies.IndexOf(ring.id);
+      if (i < 0)
+        continue;
+      ring.hint = i;
+    }
+    ring.Push(bodies.x[ring.hint], bodies.y[ring.hint], bodies.z[ring.hint]);
+    if (out != k)
+      rings[out] = std::move(ring);
+    out++;
+  }
+  rings.erase(rings.begin() + out, rings.end());
+}
+
+void Trails::Pack(std::vector<double> &out, std::vector<int> &starts) const
+{
+  out.clear();
+  starts.clear();
+  size_t total = 0;
+  for (size_t k = 0; k < rings.size(); k++)
+    total += rings[k].Count();
+  out.reserve(total * 3);
+  for (size_t k = 0; k < rings.size(); k++)
+  {
+    starts.push_back(out.size() / 3);
+    rings[k].CopyTo(out);
+  }
+  starts.push_back(out.size() / 3);
+}
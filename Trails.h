@@ -0,0 +1,58 @@
+#ifndef _TRAILS_H_
+#define _TRAILS_H_
+
+#include "Bodies.h"
+#include <vector>
+
+//Bounded ring of packed x, y, z points that grows up to its capacity; pushing onto a full ring overwrites the oldest point
+class TrailRing
+{
+public:
+  uint64_t id;    //Body the trail belongs to
+  int decimation; //Only every decimation-th recorded step is kept
+
+  TrailRing(uint64_t bodyId, size_t capacity, int decimation);
+
+  void Push(double x, double y, double z);
+  void Resize(size_t capacity);
+  void Clear();
+  size_t Capacity() const { return capacity; }
+  size_t Count() const { return count; }
+  //Appends the recorded points oldest first
+  void CopyTo(std::vector<double> &out) const;
+
+private:
+  std::vector<double> points;
+  size_t capacity;
+  size_t head; //Slot the next point goes into
+  size_t count;
+  long skipped;
+
+  friend class Trails;
+  size_t hint; //Last known index of the body, rechecked against the id every step
+};
+
+//Trails for any number of bodies, tracked by id so they survive merges reordering the body arrays
+class Trails
+{
+public:
+  //Starts a trail for the body or, if it already has one, updates its capacity and decimation.
+  //Returns false if the body was already tracked
+  bool Track(uint64_t id, size_t capacity, int decimation);
+  void Untrack(uint64_t id);
+  bool Tracked(uint64_t id) const;
+  void Clear();
+  void ClearPoints();
+  //Appends the current position of every tracked body; trails of bodies that merged away are dropped
+  void Record(const Bodies &bodies);
+  //Packs every trail into out, with starts[k] the first point of trail k and starts.back() the total point count
+  void Pack(std::vector<double> &out, std::vector<int> &starts) const;
+  size_t Size() const { return rings.size(); }
+
+private:
+  std::vector<TrailRing> rings;
+
+  long Find(uint64_t id) const;
+};
+
+#endif
@@ -0,0 +1,370 @@
+#include "Trajectory.h"
+#include <cstring>
+
+static const char TRAJECTORY_MAGIC[8] = {'O', 'R', 'B', 'T', 'R', 'A', 'J', 0};
+static const uint32_t TRAJECTORY_VERSION = 1;
+static const uint32_t FRAME_MAGIC = 0x4D415246; //"FRAM"
+
+enum ColumnCodec
+{
+  CODEC_RAW = 0,
+  CODEC_SHUFFLE_RLE = 1,
+  CODEC_DELTA_SHUFFLE_RLE = 2
+};
+
+struct FrameHeader
+{
+  uint32_t magic;
+  uint32_t columns;
+  uint64_t count;
+  int64_t step;
+  double time;
+};
+
+struct ColumnHeader
+{
+  uint32_t codec;
+  uint32_t reserved;
+  uint64_t bytes;
+};
+
+void TrajectoryFrame::Capture(const Bodies &bodies, long frameStep, double frameTime)
+{
+  count = bodies.size();
+  step = frameStep;
+  time = frameTime;
+  const void *source[COLUMNS] = {bodies.id.data(), bodies.mass.data(),
+                                 bodies.x.data(), bodies.y.data(), bodies.z.data(),
+                                 bodies.vx.data(), bodies.vy.data(), bodies.vz.data()};
+  for (int c = 0; c < COLUMNS; c++)
+  {
+    columns[c].resize(count);
+    if (count > 0)
+      memcpy(columns[c].data(), source[c], count * 8);
+  }
+}
+
+//Byte plane k holds byte k of every word, so the slowly changing high bytes line up into long runs
+static void Shuffle(const uint64_t *words, size_t count, unsigned char *out)
+{
+  const unsigned char *bytes = reinterpret_cast<const unsigned char *>(words);
+  for (size_t i = 0; i < count; i++)
+  {
+    for (int k = 0; k < 8; k++)
+      out[k * count + i] = bytes[i * 8 + k];
+  }
+}
+
+static void Unshuffle(const unsigned char *in, size_t count, uint64_t *words)
+{
+  unsigned char *bytes = reinterpret_cast<unsigned char *>(words);
+  for (size_t i = 0; i < count; i++)
+  {
+    for (int k = 0; k < 8; k++)
+      bytes[i * 8 + k] = in[k * count + i];
+  }
+}
+
+//Zero bytes are written as 0 followed by a varint run length; everything else is literal
+static void EncodeZeroRuns(const unsigned char *in, size_t size, std::vector<unsigned char> &out)
+{
+  out.clear();
+  size_t i = 0;
+  while (i < size)
+  {
+    if (in[i] != 0)
+    {
+      out.push_back(in[i++]);
+      continue;
+    }
+    size_t run = 0;
+    while (i < size && in[i] == 0)
+    {
+      run++;
+      i++;
+    }
+    out.push_back(0);
+    while (run >= 0x80)
+    {
+      out.push_back(static_cast<unsigned char>(run | 0x80));
+      run >>= 7;
+    }
+    out.push_back(static_cast<unsigned char>(run));
+  }
+}
+
+static bool DecodeZeroRuns(const unsigned char *in, size_t size, unsigned char *out, size_t expected)
+{
+  size_t o = 0;
+  size_t i = 0;
+  while (i < size)
+  {
+    if (in[i] != 0)
+    {
+      if (o >= expected)
+        return false;
+      out[o++] = in[i++];
+      continue;
+    }
+    i++;
+    size_t run = 0;
+    int shift = 0;
+    while (i < size)
+    {
+      unsigned char b = in[i++];
+      run |= static_cast<size_t>(b & 0x7F) << shift;
+      shift += 7;
+      if ((b & 0x80) == 0)
+        break;
+    }
+    if (o + run > expected)
+      return false;
+    memset(out + o, 0, run);
+    o += run;
+  }
+  return o == expected;
+}
+
+TrajectoryWriter::TrajectoryWriter() : keyframeInterval(64), queueDepth(8), file(nullptr), previous(nullptr),
+                                       stopping(false), written(0), dropped(0), sinceKeyframe(0)
+{
+}
+
+TrajectoryWriter::~TrajectoryWriter()
+{
+  Close();
+}
+
+bool TrajectoryWriter::Open(const std::string &path)
+{
+  Close();
+  file = fopen(path.c_str(), "wb");
+  if (file == nullptr)
+  {
+    printf("Could not open trajectory %s\n", path.c_str());
+    return false;
+  }
+  fwrite(TRAJECTORY_MAGIC, 1, sizeof(TRAJECTORY_MAGIC), file);
+  fwrite(&TRAJECTORY_VERSION, sizeof(TRAJECTORY_VERSION), 1, file);
+  uint32_t columns = TrajectoryFrame::COLUMNS;
+  fwrite(&columns, sizeof(columns), 1, file);
+
+  for (size_t i = 0; i < queueDepth; i++)
+    spare.push_back(new TrajectoryFrame());
+  previous = new TrajectoryFrame();
+  previous->count = 0;
+  stopping = false;
+  written = 0;
+  dropped = 0;
+  sinceKeyframe = 0;
+  thread = std::thread(&TrajectoryWriter::Loop, this);
+  return true;
+}
+
+bool TrajectoryWriter::Submit(const Bodies &bodies, long step, double time)
+{
+  TrajectoryFrame *frame = nullptr;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    if (!spare.empty())
+    {
+      frame = spare.back();
+      spare.pop_back();
+    }
+  }
+  if (frame == nullptr)
+  {
+    dropped++;
+    return false;
+  }
+  //Copy outside the lock so the writer thread keeps going meanwhile
+  frame->Capture(bodies, step, time);
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    queue.push_back(frame);
+  }
+  wake.notify_one();
+  return true;
+}
+
+void TrajectoryWriter::Close()
+{
+  if (file == nullptr)
+    return;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  wake.notify_one();
+  thread.join();
+  fclose(file);
+  file = nullptr;
+  for (size_t i = 0; i < spare.size(); i++)
+    delete spare[i];
+  spare.clear();
+  delete previous;
+  previous = nullptr;
+  if (dropped > 0)
+    printf("Trajectory writer fell behind and dropped %ld frames\n", dropped);
+}
+
+void TrajectoryWriter::Loop()
+{
+  while (true)
+  {
+    TrajectoryFrame *frame;
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      wake.wait(guard, [this] { return stopping || !queue.empty(); });
+      //Drain whatever is queued before honouring a stop
+      if (queue.empty())
+        return;
+      frame = queue.front();
+      queue.pop_front();
+    }
+    WriteFrame(frame);
+    //The frame just written becomes the delta reference; the old reference goes back to the pool
+    TrajectoryFrame *old = previous;
+    previous = frame;
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      spare.push_back(old);
+    }
+  }
+}
+
+void TrajectoryWriter::WriteFrame(TrajectoryFrame *frame)
+{
+  size_t count = frame->count;
+  bool delta = sinceKeyframe > 0 && previous->count == count &&
+               memcmp(previous->columns[0].data(), frame->columns[0].data(), count * 8) == 0;
+  sinceKeyframe = delta ? sinceKeyframe + 1 : 1;
+  if (sinceKeyframe >= keyframeInterval)
+    sinceKeyframe = 0;
+
+  FrameHeader header;
+  header.magic = FRAME_MAGIC;
+  header.columns = TrajectoryFrame::COLUMNS;
+  header.count = count;
+  header.step = frame->step;
+  header.time = frame->time;
+  fwrite(&header, sizeof(header), 1, file);
+
+  words.resize(count);
+  scratch.resize(count * 8);
+  for (int c = 0; c < TrajectoryFrame::COLUMNS; c++)
+  {
+    const uint64_t *column = frame->columns[c].data();
+    ColumnHeader ch;
+    ch.reserved = 0;
+    if (delta)
+    {
+      const uint64_t *reference = previous->columns[c].data();
+      for (size_t i = 0; i < count; i++)
+        words[i] = column[i] ^ reference[i];
+      column = words.data();
+    }
+    Shuffle(column, count, scratch.data());
+    EncodeZeroRuns(scratch.data(), count * 8, encoded);
+    if (encoded.size() < count * 8)
+    {
+      ch.codec = delta ? CODEC_DELTA_SHUFFLE_RLE : CODEC_SHUFFLE_RLE;
+      ch.bytes = encoded.size();
+      fwrite(&ch, sizeof(ch), 1, file);
+      fwrite(encoded.data(), 1, encoded.size(), file);
+    }
+    else
+    {
+      ch.codec = CODEC_RAW;
+      ch.bytes = count * 8;
+      fwrite(&ch, sizeof(ch), 1, file);
+      fwrite(frame->columns[c].data(), 8, count, file);
+    }
+  }
+  written++;
+}
+
+TrajectoryReader::TrajectoryReader() : file(nullptr)
+{
+  previous.count = 0;
+}
+
+TrajectoryReader::~TrajectoryReader()
+{
+  Close();
+}
+
+bool TrajectoryReader::Open(const std::string &path)
+{
+  Close();
+  file = fopen(path.c_str(), "rb");
+  if (file == nullptr)
+  {
+    printf("Could not open trajectory %s\n", path.c_str());
+    return false;
+  }
+  char magic[8];
+  uint32_t version = 0, columns = 0;
+  if (fread(magic, 1, 8, file) != 8 || memcmp(magic, TRAJECTORY_MAGIC, 8) != 0 ||
+      fread(&version, sizeof(version), 1, file) != 1 || fread(&columns, sizeof(columns), 1, file) != 1 ||
+      version != TRAJECTORY_VERSION || columns != TrajectoryFrame::COLUMNS)
+  {
+    printf("%s is not a supported trajectory file\n", path.c_str());
+    Close();
+    return false;
+  }
+  previous.count = 0;
+  return true;
+}
+
+bool TrajectoryReader::Next(TrajectoryFrame &frame)
+{
+  if (file == nullptr)
+    return false;
+  FrameHeader header;
+  if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != FRAME_MAGIC || header.columns != TrajectoryFrame::COLUMNS)
+    return false;
+  size_t count = header.count;
+  frame.count = count;
+  frame.step = header.step;
+  frame.time = header.time;
+  scratch.resize(count * 8);
+  for (int c = 0; c < TrajectoryFrame::COLUMNS; c++)
+  {
+    ColumnHeader ch;
+    if (fread(&ch, sizeof(ch), 1, file) != 1)
+      return false;
+    encoded.resize(ch.bytes);
+    if (ch.bytes > 0 && fread(encoded.data(), 1, ch.bytes, file) != ch.bytes)
+      return false;
+    std::vector<uint64_t> &column = frame.columns[c];
+    column.resize(count);
+    if (ch.codec == CODEC_RAW)
+    {
+      if (ch.bytes != count * 8)
+        return false;
+      if (count > 0)
+        memcpy(column.data(), encoded.data(), count * 8);
+      continue;
+    }
+    if (!DecodeZeroRuns(encoded.data(), encoded.size(), scratch.data(), count * 8))
+      return false;
+    Unshuffle(scratch.data(), count, column.data());
+    if (ch.codec == CODEC_DELTA_SHUFFLE_RLE)
+    {
+      if (previous.count != count)
+        return false;
+      for (size_t i = 0; i < count; i++)
+        column[i] ^= previous.columns[c][i];
+    }
+  }
+  previous = frame;
+  return true;
+}
+
+void TrajectoryReader::Close()
+{
+  if (file != nullptr)
+    fclose(file);
+  file = nullptr;
+}
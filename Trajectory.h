@@ -0,0 +1,83 @@
+#ifndef _TRAJECTORY_H_
+#define _TRAJECTORY_H_
+
+#include "Bodies.h"
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+//One recorded step: the id column plus mass, position and velocity columns
+struct TrajectoryFrame
+{
+  static const int COLUMNS = 8;
+  size_t count;
+  long step;
+  double time;
+  std::vector<uint64_t> columns[COLUMNS]; //Raw 64 bit words; doubles are stored by bit pattern
+
+  void Capture(const Bodies &bodies, long frameStep, double frameTime);
+};
+
+//Streams frames to a chunked, compressed, column oriented file from a background thread.
+//Each column is XOR'd against the previous frame when the body set is unchanged, byte-shuffled and
+//zero-run-length encoded. Every keyframeInterval frames the delta chain restarts so readers can seek.
+class TrajectoryWriter
+{
+public:
+  int keyframeInterval;
+  size_t queueDepth; //Frames buffered before new ones are dropped instead of stalling the caller
+
+  TrajectoryWriter();
+  ~TrajectoryWriter();
+
+  bool Open(const std::string &path);
+  bool IsOpen() const { return file != nullptr; }
+  //Copies the body state and returns immediately; false if the frame had to be dropped
+  bool Submit(const Bodies &bodies, long step, double time);
+  void Close();
+
+  long Written() const { return written; }
+  long Dropped() const { return dropped; }
+
+private:
+  FILE *file;
+  std::thread thread;
+  std::mutex lock;
+  std::condition_variable wake;
+  std::deque<TrajectoryFrame *> queue;
+  std::vector<TrajectoryFrame *> spare;
+  TrajectoryFrame *previous;
+  std::vector<uint64_t> words; //XOR of a column with the previous frame's
+  std::vector<unsigned char> scratch;
+  std::vector<unsigned char> encoded;
+  bool stopping;
+  long written;
+  long dropped;
+  long sinceKeyframe;
+
+  void Loop();
+  void WriteFrame(TrajectoryFrame *frame);
+};
+
+//Sequential decoder for files written by TrajectoryWriter
+class TrajectoryReader
+{
+public:
+  TrajectoryReader();
+  ~TrajectoryReader();
+
+  bool Open(const std::string &path);
+  bool Next(TrajectoryFrame &frame);
+  void Close();
+
+private:
+  FILE *file;
+  TrajectoryFrame previous;
+  std::vector<unsigned char> encoded;
+  std::vector<unsigned char> scratch;
+};
+
+#endif
@@ -0,0 +1,139 @@
+#include "Transform.h"
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TRANSFORM_X86
+#include <immintrin.h>
+#endif
+
+Matrix4 Matrix4::Identity()
+{
+  Matrix4 r = {{1, 0, 0, 0,
+                0, 1, 0, 0,
+                0, 0, 1, 0,
+                0, 0, 0, 1}};
+  return r;
+}
+
+Matrix4 Matrix4::RotationX(double angle)
+{
+  double c = cos(angle), s = sin(angle);
+  Matrix4 r = {{1, 0, 0, 0,
+                0, c, -s, 0,
+                0, s, c, 0,
+                0, 0, 0, 1}};
+  return r;
+}
+
+Matrix4 Matrix4::RotationY(double angle)
+{
+  double c = cos(angle), s = sin(angle);
+  Matrix4 r = {{c, 0, s, 0,
+                0, 1, 0, 0,
+                -s, 0, c, 0,
+                0, 0, 0, 1}};
+  return r;
+}
+
+Matrix4 Matrix4::RotationZ(double angle)
+{
+  double c = cos(angle), s = sin(angle);
+  Matrix4 r = {{c, -s, 0, 0,
+                s, c, 0, 0,
+                0, 0, 1, 0,
+                0, 0, 0, 1}};
+  return r;
+}
+
+Matrix4 Matrix4::Scale(double sx, double sy, double sz)
+{
+  Matrix4 r = {{sx, 0, 0, 0,
+                0, sy, 0, 0,
+                0, 0, sz, 0,
+                0, 0, 0, 1}};
+  return r;
+}
+
+Matrix4 Matrix4::Translation(double tx, double ty, double tz)
+{
+  Matrix4 r = {{1, 0, 0, tx,
+                0, 1, 0, ty,
+                0, 0, 1, tz,
+                0, 0, 0, 1}};
+  return r;
+}
+
+Matrix4 Matrix4::operator*(const Matrix4 &other) const
+{
+  Matrix4 r;
+  for (int row = 0; row < 4; row++)
+  {
+    for (int col = 0; col < 4; col++)
+    {
+      double sum = 0;
+      for (int k = 0; k < 4; k++)
+        sum += m[row * 4 + k] * other.m[k * 4 + col];
+      r.m[row * 4 + col] = sum;
+    }
+  }
+  return r;
+}
+
+static void ProjectScalar(const Matrix4 &t, const double *x, const double *y, const double *z, size_t begin, size_t end,
+                          double *sx, double *sy)
+{
+  for (size_t i = begin; i < end; i++)
+  {
+    sx[i] = t.X(x[i], y[i], z[i]);
+    sy[i] = t.Y(x[i], y[i], z[i]);
+  }
+}
+
+#ifdef TRANSFORM_X86
+__attribute__((target("avx2,fma"))) static size_t ProjectAvx2(const Matrix4 &t, const double *x, const double *y, const double *z,
+                                                              size_t n, double *sx, double *sy)
+{
+  __m256d m0 = _mm256_set1_pd(t.m[0]), m1 = _mm256_set1_pd(t.m[1]), m2 = _mm256_set1_pd(t.m[2]), m3 = _mm256_set1_pd(t.m[3]);
+  __m256d m4 = _mm256_set1_pd(t.m[4]), m5 = _mm256_set1_pd(t.m[5]), m6 = _mm256_set1_pd(t.m[6]), m7 = _mm256_set1_pd(t.m[7]);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    __m256d px = _mm256_loadu_pd(x + i);
+    __m256d py = _mm256_loadu_pd(y + i);
+    __m256d pz = _mm256_loadu_pd(z + i);
+    __m256d rx = _mm256_fmadd_pd(m0, px, _mm256_fmadd_pd(m1, py, _mm256_fmadd_pd(m2, pz, m3)));
+    __m256d ry = _mm256_fmadd_pd(m4, px, _mm256_fmadd_pd(m5, py, _mm256_fmadd_pd(m6, pz, m7)));
+    _mm256_storeu_pd(sx + i, rx);
+    _mm256_storeu_pd(sy + i, ry);
+  }
+  return i;
+}
+#endif
+
+void ProjectPoints(KernelIsa isa, const Matrix4 &matrix, const double *x, const double *y, const double *z, size_t n,
+                   ScreenPoints &out)
+{
+  out.Resize(n);
+  size_t done = 0;
+#ifdef TRANSFORM_X86
+  //AVX-512 gains nothing on a loop this memory bound, so both vector levels use the AVX2 path
+  if (isa != ISA_SCALAR)
+    done = ProjectAvx2(matrix, x, y, z, n, out.x.data(), out.y.data());
+#else
+  (void)isa;
+#endif
+  ProjectScalar(matrix, x, y, z, done, n, out.x.data(), out.y.data());
+}
+
+void ProjectPacked(const Matrix4 &matrix, const double *xyz, size_t n, ScreenPoints &out)
+{
+  out.Resize(n);
+  double *sx = out.x.data();
+  double *sy = out.y.data();
+  for (size_t i = 0; i < n; i++)
+  {
+    const double *p = xyz + i * 3;
+    sx[i] = matrix.X(p[0], p[1], p[2]);
+    sy[i] = matrix.Y(p[0], p[1], p[2]);
+  }
+}
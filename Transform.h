@@ -0,0 +1,43 @@
+#ifndef _TRANSFORM_H_
+#define _TRANSFORM_H_
+
+#include "Bodies.h"
+#include "Kernel.h"
+
+//Row-major 4x4 affine transform acting on column vectors (x, y, z, 1)
+struct Matrix4
+{
+  double m[16];
+
+  static Matrix4 Identity();
+  static Matrix4 RotationX(double angle);
+  static Matrix4 RotationY(double angle);
+  static Matrix4 RotationZ(double angle);
+  static Matrix4 Scale(double sx, double sy, double sz);
+  static Matrix4 Translation(double tx, double ty, double tz);
+
+  Matrix4 operator*(const Matrix4 &other) const;
+  double X(double x, double y, double z) const { return m[0] * x + m[1] * y + m[2] * z + m[3]; }
+  double Y(double x, double y, double z) const { return m[4] * x + m[5] * y + m[6] * z + m[7]; }
+};
+
+//Screen-space coordinates, one entry per projected point; reused across frames so steady state never allocates
+struct ScreenPoints
+{
+  AlignedDoubles x, y;
+
+  void Resize(size_t n)
+  {
+    x.resize(n);
+    y.resize(n);
+  }
+  size_t size() const { return x.size(); }
+};
+
+//Projects n points given as separate x, y, z arrays through the first two rows of the matrix
+void ProjectPoints(KernelIsa isa, const Matrix4 &matrix, const double *x, const double *y, const double *z, size_t n,
+                   ScreenPoints &out);
+//Same for n points packed as x, y, z triples
+void ProjectPacked(const Matrix4 &matrix, const double *xyz, size_t n, ScreenPoints &out);
+
+#endif
@@ -9,6 +9,8 @@
 #include <memory>
 #include <ctime>
 #include <vector>
+#include <chrono>
+#include <map>
 
 using namespace std;
 
@@ -27,5 +29,26 @@ using namespace std;
 
 /*=======CLASS DEFINITIONS=======*/
 
+#include "Bodies.h"
+#include "Collisions.h"
+#include "Gravity.h"
+#include "Integrator.h"
+#include "Random.h"
+#include "BlockHermite.h"
+#include "SimThread.h"
+#include "Snapshot.h"
+#include "Trajectory.h"
+#include "Trails.h"
+#include "Transform.h"
+#include "Camera.h"
+#include "GLRenderer.h"
+#include "Raster.h"
+#include "FrameEncoder.h"
+#include "CameraScript.h"
+#include "Scenario.h"
+#include "Benchmark.h"
+#include "Profiler.h"
+#include "ProfileOverlay.h"
+#include "Diagnostics.h"
 
 #endif
\ No newline at end of file
@@ -6,11 +6,31 @@ bool Init();
 void CleanUp();
 void Run();
 void Setup();
-void Rots();
+bool LoadScene();
+void Checkpoint();
 void Convert();
+void Cull();
 void Draw();
+void Rasterize();
+bool StartOffscreen();
+void RenderOffscreen();
 void Simulate();
-vector<vector<double>> MultMatrixs(vector<vector<double>> mat1, vector<vector<double>> mat2);
+bool ParseArgs(int argc, char *argv[]);
+bool ApplyScenario();
+void ForceError(const vector<double> &ax, const vector<double> &ay, const vector<double> &az, double &rms, double &worst);
+void CheckTheta();
+void CheckFmm();
+void RunBenchmark();
+bool MakeIntegrator(const string &name);
+void RunHeadless();
+void WriteSnapshot();
+bool OpenTrajectory();
+void RecordTrajectory();
+void TrajectoryInfo();
+void SimStep();
+void FollowTrail();
+bool ParseTrail(const string &spec);
+void PublishFrame(SimFrame &frame);
 void DrawCircle(SDL_Point center, int radius, SDL_Color color);
 
 SDL_Window *window;
@@ -19,9 +39,30 @@ SDL_Surface *gScreenSurface = nullptr;
 SDL_Renderer *renderer = nullptr;
 SDL_Rect pos;
 
+enum RenderBackend
+{
+    RENDER_SOFT, //Scanline rasteriser into a streaming texture, one upload per frame
+    RENDER_SDL,  //SDL_Renderer rectangles, one call per pixel column
+    RENDER_GL    //Instanced GL renderer
+};
+RenderBackend backend = RENDER_SOFT;
+GLRenderer glRenderer;
+Raster raster;
+SDL_Texture *screenTexture = nullptr;
+long renderEvery = 0; //Headless runs render every renderEvery-th step to image files when set
+string renderPrefix = "frame";
+int encoders = 2; //Threads encoding rendered frames
+FrameEncoder encoder;
+string cameraScriptPath;
+CameraScript cameraScript;
+SimFrame offscreenFrame; //Headless stand-in for the frame the simulation thread publishes
+vector<int> visible; //Bodies on screen this frame, discs first and sub-pixel splats from splatStart on
+vector<int> splats;
+int splatStart = 0;
+double lodPixels = 2; //Bodies drawn this many pixels across or fewer go to the splat pass
+
 int screenWidth = 500;
 int screenHeight = 500;
-bool run = false;
 double mag = 0;
 double zoom;
 double posx = 0;
@@ -32,22 +73,73 @@ double timeStep;
 int followObject = -1;
 int px = 0;
 int py = 0;
-double yang = 0;
-double xang = 0;
-double zang = 0;
 double xper = 1;
 double yper = 1;
 double zper = 1;
 int step = 1;
+int ringBodies = 20; //Random orbiters per ring in Setup()
+bool checkTheta = false;
+bool checkFmm = false;
+#ifdef ORBIT_BENCHMARK
+string benchmarkPath = "benchmark.json"; //Built as the benchmark executable, so the suite runs without options
+#else
+string benchmarkPath; //Runs the benchmark suite and writes its results here when set
+#endif
+string benchSizes = "100,1000,10000,100000,1000000";
+string benchIntegrators = "euler,leapfrog";
+string benchThreads; //Empty measures one thread and every core
+int benchRepeats = 5;
+double benchBudget = 2; //Seconds of repeats per case before it settles for fewer samples
+int benchDirectLimit = 20000; //Larger scenes use Barnes-Hut when the direct solver is selected
+uint64_t benchSeed = 1; //Fixed rather than --seed, so results stay comparable between runs
+Gravity gravity;
+Collisions collisions;
+unique_ptr<Integrator> integrator;
+string integratorName = "euler"; //--integrator; "block" always sums forces directly and ignores --solver
+double tolerance = 1e-9; //Error tolerance for the adaptive integrators
+double eta = 0.02; //Block time step accuracy parameter
+ThreadPool pool;
+int threads = 0; //Worker threads for the force pass, 0 uses every core
+bool headless = false;
+long maxSteps = -1;
+double untilTime = -1;
+long snapshotEvery = 0;
+string outputPrefix = "snapshot";
+Random rng;
+Scenario scenario; //Replaces Setup() when --scenario is given
+uint64_t seed = time(NULL);
+string restorePath;
+string checkpointPath = "checkpoint.bin";
+long checkpointEvery = 0;
+string snapshotFormat = "csv";
+TrajectoryWriter trajectory;
+string trajectoryPath; //Streams every trajectoryEvery-th step here when set
+long trajectoryEvery = 1;
+string trajectoryInfoPath;
+Diagnostics diagnostics;
+string diagnosticsPath; //Logs energy, momentum and angular momentum here every diagnostics.every steps when set
+SimThread sim;
+double simRate = 1000; //Simulation steps per wall-clock second, 0 for as fast as possible
+int stepsPerFrame = 0; //When set, paces the simulation to this many steps per rendered frame instead
+const SimFrame *frame = nullptr; //Latest state published by the simulation thread
+int viewFollow = -1; //Body the view follows: frame->follow, unless a key released it before the simulation caught up
+bool followReleased = false;
+int trailDecimation = 1; //Steps per recorded point of the followed body's trail
+const size_t maxFollowTrail = 1 << 18; //Points kept for the followed body however small the time step gets
+uint64_t followTrail = UINT64_MAX; //Body id whose trail FollowTrail() started, if any
+long stepCount = 0;
+double simTime = 0;
 
-vector<vector<double>> objects;
-vector<vector<double>> pps;
-vector<vector<double>> trail;
-vector<vector<double>> tps;
-vector<vector<double>> rotx;
-vector<vector<double>> roty;
-vector<vector<double>> rotz;
-vector<vector<double>> projection;
+Bodies objects;
+ScreenPoints pps; //Screen position of every body
+Trails trails;
+ScreenPoints tps; //Screen position of every trail point
+Camera camera;
+#ifdef ORBIT_PROFILE
+ProfileOverlay overlay; //F1 toggles it, F2 writes the trace
+string fontPath;
+string tracePath; //Trace written on exit when set, and by F2 (trace.json when unset)
+#endif
 
 bool Init()
 {
@@ -81,19 +173,89 @@ bool Init()
         printf("Could not create window: %s\n", SDL_GetError());
         return false;
     }
-    else{
-        gScreenSurface = SDL_GetWindowSurface(window);
-        renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+    else
         SDL_Log("Window Successful Generated");
-    }
+
     //Map OpenGL Context to Window
     glContext = SDL_GL_CreateContext(window);
+    if (backend == RENDER_GL)
+    {
+        if (glContext != NULL && SDL_GL_MakeCurrent(window, glContext) == 0 && glRenderer.Init())
+            return true;
+        printf("GL renderer unavailable, falling back to SDL\n");
+        backend = RENDER_SDL;
+    }
+    gScreenSurface = SDL_GetWindowSurface(window);
+    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+    if (backend == RENDER_SOFT)
+    {
+        screenTexture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, screenWidth, screenHeight);
+        if (screenTexture == NULL)
+        {
+            printf("Could not create screen texture, falling back to SDL rectangles: %s\n", SDL_GetError());
+            backend = RENDER_SDL;
+        }
+        raster.Resize(screenWidth, screenHeight);
+    }
 
+#ifdef ORBIT_PROFILE
+    if (renderer != nullptr)
+        overlay.Open(fontPath, 14);
+#endif
     return true;
 }
 
-int main()
+int main(int argc, char *argv[])
 {
+    if (!ParseArgs(argc, argv))
+        return -1;
+    rng.state = seed;
+
+    pool.Resize(threads);
+    gravity.pool = &pool;
+    if (!MakeIntegrator(integratorName))
+        return -1;
+
+    if (!trajectoryInfoPath.empty())
+    {
+        TrajectoryInfo();
+        return 0;
+    }
+
+    if (checkTheta)
+    {
+        CheckTheta();
+        return 0;
+    }
+
+    if (checkFmm)
+    {
+        CheckFmm();
+        return 0;
+    }
+
+    if (!benchmarkPath.empty())
+    {
+        RunBenchmark();
+        return 0;
+    }
+
+    if (!OpenTrajectory())
+        return -1;
+    if (!diagnosticsPath.empty() && !diagnostics.Open(diagnosticsPath))
+        return -1;
+
+    if (headless)
+    {
+        RunHeadless();
+        trajectory.Close();
+#ifdef ORBIT_PROFILE
+        if (!tracePath.empty())
+            profiler.WriteTrace(tracePath);
+#endif
+        return 0;
+    }
+
     //Error Checking/Initialisation
     if (!Init())
     {
@@ -107,8 +269,11 @@ int main()
 
     //Swap Render Buffers
     SDL_GL_SwapWindow(window);
-    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-    SDL_RenderClear(renderer);
+    if (renderer != nullptr)
+    {
+        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+        SDL_RenderClear(renderer);
+    }
 
     Run();
 
@@ -116,9 +281,705 @@ int main()
     return 0;
 }
 
+bool ParseArgs(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--solver" && hasValue)
+        {
+            if (!ParseSolver(argv[++i], gravity.solver))
+            {
+                printf("Unknown solver: %s\n", argv[i]);
+                return false;
+            }
+        }
+        else if (arg == "--theta" && hasValue)
+        {
+            gravity.theta = atof(argv[++i]);
+            if (!(gravity.theta > 0 && gravity.theta <= 1))
+            {
+                printf("Bad theta, expected 0 < theta <= 1: %s\n", argv[i]);
+                return false;
+            }
+        }
+        else if (arg == "--isa" && hasValue)
+        {
+            if (!ParseIsa(argv[++i], gravity.isa))
+            {
+                printf("Unknown instruction set: %s\n", argv[i]);
+                return false;
+            }
+        }
+        else if (arg == "--precision" && hasValue)
+        {
+            if (!ParsePrecision(argv[++i], gravity.precision))
+            {
+                printf("Unknown precision: %s\n", argv[i]);
+                return false;
+            }
+        }
+        else if (arg == "--force-law" && hasValue)
+        {
+            if (!ParseForceLaw(argv[++i], gravity.law.kind))
+            {
+                printf("Unknown force law: %s\n", argv[i]);
+                return false;
+            }
+        }
+        else if (arg == "--softening" && hasValue)
+            gravity.law.softening = atof(argv[++i]);
+        else if (arg == "--yukawa-alpha" && hasValue)
+            gravity.law.alpha = atof(argv[++i]);
+        else if (arg == "--yukawa-lambda" && hasValue)
+            gravity.law.lambda = atof(argv[++i]);
+        else if (arg == "--threads" && hasValue)
+            threads = atoi(argv[++i]);
+        else if (arg == "--ring-bodies" && hasValue)
+            ringBodies = atoi(argv[++i]);
+        else if (arg == "--check-theta")
+            checkTheta = true;
+        else if (arg == "--check-fmm")
+            checkFmm = true;
+        else if (arg == "--fmm-order" && hasValue)
+        {
+            gravity.order = atoi(argv[++i]);
+            if (gravity.order < 1 || gravity.order > Fmm::MaxOrder)
+            {
+                printf("Bad FMM order, expected 1 to %d: %s\n", Fmm::MaxOrder, argv[i]);
+                return false;
+            }
+        }
+        else if (arg == "--benchmark" && hasValue)
+            benchmarkPath = argv[++i];
+        else if (arg == "--bench-sizes" && hasValue)
+            benchSizes = argv[++i];
+        else if (arg == "--bench-integrators" && hasValue)
+            benchIntegrators = argv[++i];
+        else if (arg == "--bench-threads" && hasValue)
+            benchThreads = argv[++i];
+        else if (arg == "--bench-repeats" && hasValue)
+            benchRepeats = max(atoi(argv[++i]), 1);
+        else if (arg == "--bench-budget" && hasValue)
+            benchBudget = atof(argv[++i]);
+        else if (arg == "--bench-direct-limit" && hasValue)
+            benchDirectLimit = atoi(argv[++i]);
+        else if (arg == "--bench-seed" && hasValue)
+            benchSeed = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--headless")
+            headless = true;
+        else if (arg == "--steps" && hasValue)
+            maxSteps = atol(argv[++i]);
+        else if (arg == "--until" && hasValue)
+            untilTime = atof(argv[++i]);
+        else if (arg == "--rate" && hasValue)
+            rate = atof(argv[++i]);
+        else if (arg == "--snapshot-every" && hasValue)
+            snapshotEvery = atol(argv[++i]);
+        else if (arg == "--output" && hasValue)
+            outputPrefix = argv[++i];
+        else if (arg == "--snapshot-format" && hasValue)
+        {
+            snapshotFormat = argv[++i];
+            if (snapshotFormat != "csv" && snapshotFormat != "bin")
+            {
+                printf("Unknown snapshot format: %s\n", argv[i]);
+                return false;
+            }
+        }
+        else if (arg == "--seed" && hasValue)
+            seed = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--restore" && hasValue)
+            restorePath = argv[++i];
+        else if (arg == "--checkpoint" && hasValue)
+            checkpointPath = argv[++i];
+        else if (arg == "--checkpoint-every" && hasValue)
+            checkpointEvery = atol(argv[++i]);
+        else if (arg == "--trajectory" && hasValue)
+            trajectoryPath = argv[++i];
+        else if (arg == "--trajectory-every" && hasValue)
+            trajectoryEvery = max(atol(argv[++i]), 1L);
+        else if (arg == "--trajectory-queue" && hasValue)
+            trajectory.queueDepth = max(atoi(argv[++i]), 1);
+        else if (arg == "--trajectory-info" && hasValue)
+            trajectoryInfoPath = argv[++i];
+        else if (arg == "--diagnostics" && hasValue)
+            diagnosticsPath = argv[++i];
+        else if (arg == "--diagnostics-every" && hasValue)
+            diagnostics.every = max(atol(argv[++i]), 1L);
+        else if (arg == "--trail" && hasValue)
+        {
+            if (!ParseTrail(argv[++i]))
+            {
+                printf("Bad trail, expected ID[:CAPACITY[:DECIMATION]]: %s\n", argv[i]);
+                return false;
+            }
+        }
+        else if (arg == "--trail-decimation" && hasValue)
+            trailDecimation = max(atoi(argv[++i]), 1);
+        else if (arg == "--renderer" && hasValue)
+        {
+            string name = argv[++i];
+            if (name == "soft")
+                backend = RENDER_SOFT;
+            else if (name == "sdl")
+                backend = RENDER_SDL;
+            else if (name == "gl")
+                backend = RENDER_GL;
+            else
+            {
+                printf("Unknown renderer: %s\n", name.c_str());
+                return false;
+            }
+        }
+        else if (arg == "--render-every" && hasValue)
+            renderEvery = atol(argv[++i]);
+        else if (arg == "--render-output" && hasValue)
+            renderPrefix = argv[++i];
+        else if (arg == "--render-format" && hasValue)
+        {
+            if (!ParseFrameFormat(argv[++i], encoder.format))
+            {
+                printf("Unknown frame format: %s\n", argv[i]);
+                return false;
+            }
+        }
+        else if (arg == "--render-size" && hasValue)
+        {
+            if (sscanf(argv[++i], "%dx%d", &screenWidth, &screenHeight) != 2 || screenWidth <= 0 || screenHeight <= 0)
+            {
+                printf("Bad render size, expected WIDTHxHEIGHT: %s\n", argv[i]);
+                return false;
+            }
+        }
+        else if (arg == "--encoders" && hasValue)
+            encoders = max(atoi(argv[++i]), 1);
+        else if (arg == "--camera-script" && hasValue)
+            cameraScriptPath = argv[++i];
+        else if (arg == "--lod-pixels" && hasValue)
+            lodPixels = atof(argv[++i]);
+        else if (arg == "--scenario" && hasValue)
+        {
+            //Settings from the file apply here, so options after --scenario override them
+            if (!scenario.Load(argv[++i]) || !ApplyScenario())
+                return false;
+        }
+        else if (arg == "--integrator" && hasValue)
+            integratorName = argv[++i];
+        else if ((arg == "--tolerance" || arg == "--eta") && hasValue)
+        {
+            double value = atof(argv[++i]);
+            if (!(value > 0))
+            {
+                printf("Bad %s, expected a positive number: %s\n", arg.c_str() + 2, argv[i]);
+                return false;
+            }
+            if (arg == "--tolerance")
+                tolerance = value;
+            else
+                eta = value;
+        }
+        else if (arg == "--sim-rate" && hasValue)
+            simRate = atof(argv[++i]);
+        else if (arg == "--steps-per-frame" && hasValue)
+            stepsPerFrame = atoi(argv[++i]);
+#ifdef ORBIT_PROFILE
+        else if (arg == "--font" && hasValue)
+            fontPath = argv[++i];
+        else if (arg == "--profile-trace" && hasValue)
+            tracePath = argv[++i];
+#endif
+        else
+        {
+            printf("Unknown argument: %s\n", arg.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+//Copies the scenario's [simulation] settings into the globals the command line would set
+bool ApplyScenario()
+{
+    for (map<string, string>::const_iterator it = scenario.simulation.begin(); it != scenario.simulation.end(); ++it)
+    {
+        const string &key = it->first;
+        double value = 0;
+        bool number = scenario.Number(key, value);
+        bool ok = true;
+        if (key == "seed")
+            seed = strtoull(it->second.c_str(), nullptr, 10);
+        else if (key == "integrator")
+            integratorName = it->second;
+        else if (key == "solver")
+            ok = ParseSolver(it->second, gravity.solver);
+        else if (key == "force_law")
+            ok = ParseForceLaw(it->second, gravity.law.kind);
+        else if (key == "softening" || key == "yukawa_alpha" || key == "yukawa_lambda")
+        {
+            ok = number && value >= 0;
+            if (key == "softening")
+                gravity.law.softening = value;
+            else if (key == "yukawa_alpha")
+                gravity.law.alpha = value;
+            else
+                gravity.law.lambda = value;
+        }
+        else if (key == "fmm_order")
+        {
+            ok = number && value >= 1 && value <= Fmm::MaxOrder;
+            gravity.order = value;
+        }
+        else if (key == "G" || key == "dt" || key == "rate" || key == "theta" || key == "tolerance" || key == "eta")
+        {
+            ok = number;
+            if (key == "G")
+                gravity.G = value;
+            else if (key == "dt")
+            {
+                ok = number && value > 0;
+                rate = log2(value); //The step is 2^rate everywhere else
+            }
+            else if (key == "rate")
+                rate = value;
+            else if (key == "theta")
+            {
+                ok = number && value > 0 && value <= 1;
+                gravity.theta = value;
+            }
+            else if (key == "tolerance")
+            {
+                ok = number && value > 0;
+                tolerance = value;
+            }
+            else
+            {
+                ok = number && value > 0;
+                eta = value;
+            }
+        }
+        else
+        {
+            printf("%s: unknown simulation setting %s\n", scenario.path.c_str(), key.c_str());
+            return false;
+        }
+        if (!ok)
+        {
+            printf("%s: bad value for %s: %s\n", scenario.path.c_str(), key.c_str(), it->second.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+//Parses ID[:CAPACITY[:DECIMATION]] and starts a trail for that body id
+bool ParseTrail(const string &spec)
+{
+    unsigned long long id = 0;
+    unsigned long capacity = 10000;
+    int decimation = 1;
+    int fields = sscanf(spec.c_str(), "%llu:%lu:%d", &id, &capacity, &decimation);
+    if (fields < 1 || capacity == 0 || decimation < 1)
+        return false;
+    trails.Track(id, capacity, decimation);
+    return true;
+}
+
+//RMS and largest relative error of the accelerations in objects against reference values
+void ForceError(const vector<double> &ax, const vector<double> &ay, const vector<double> &az, double &rms, double &worst)
+{
+    int n = objects.size();
+    double sum = 0;
+    worst = 0;
+    for (int i = 0; i < n; i++)
+    {
+        double dx = objects.ax[i] - ax[i];
+        double dy = objects.ay[i] - ay[i];
+        double dz = objects.az[i] - az[i];
+        double ref = sqrt(ax[i] * ax[i] + ay[i] * ay[i] + az[i] * az[i]);
+        double err = ref > 0 ? sqrt(dx * dx + dy * dy + dz * dz) / ref : 0;
+        sum += err * err;
+        worst = max(worst, err);
+    }
+    rms = sqrt(sum / max(n, 1));
+}
+
+//Compares Barnes-Hut against direct summation on the Setup() scene for a range of opening angles
+void CheckTheta()
+{
+    if (!LoadScene())
+        return;
+    int n = objects.size();
+    GravitySolver solver = gravity.solver;
+    double theta = gravity.theta;
+
+    gravity.solver = SOLVER_DIRECT;
+    auto start = chrono::steady_clock::now();
+    gravity.Accelerations(objects);
+    double directTime = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    vector<double> ax(objects.ax.begin(), objects.ax.end());
+    vector<double> ay(objects.ay.begin(), objects.ay.end());
+    vector<double> az(objects.az.begin(), objects.az.end());
+
+    printf("bodies %d, threads %d, kernel %s %s, direct %.4f s\n", n, pool.Size(), IsaName(gravity.isa), gravity.precision == PRECISION_SINGLE ? "single" : "double", directTime);
+    printf("theta   rms err     max err     time (s)\n");
+    gravity.solver = SOLVER_BARNES_HUT;
+    double thetas[] = {0.1, 0.2, 0.3, 0.4, 0.5, 0.6, 0.7, 0.8, 1.0};
+    for (double t : thetas)
+    {
+        gravity.theta = t;
+        start = chrono::steady_clock::now();
+        gravity.Accelerations(objects);
+        double treeTime = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        double rms, worst;
+        ForceError(ax, ay, az, rms, worst);
+        printf("%-7.2f %-11.3e %-11.3e %.4f\n", t, rms, worst, treeTime);
+    }
+
+    gravity.solver = solver;
+    gravity.theta = theta;
+}
+
+//Compares the fast multipole solver against direct summation on the Setup() scene for each expansion order,
+//at the current theta, with the potential checked as well
+void CheckFmm()
+{
+    if (!LoadScene())
+        return;
+    int n = objects.size();
+    GravitySolver solver = gravity.solver;
+    int order = gravity.order;
+
+    gravity.solver = SOLVER_DIRECT;
+    gravity.potential = true;
+    auto start = chrono::steady_clock::now();
+    gravity.Accelerations(objects);
+    double directTime = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    vector<double> ax(objects.ax.begin(), objects.ax.end());
+    vector<double> ay(objects.ay.begin(), objects.ay.end());
+    vector<double> az(objects.az.begin(), objects.az.end());
+    vector<double> phi(gravity.phi.begin(), gravity.phi.end());
+
+    printf("bodies %d, threads %d, theta %g, direct %.4f s\n", n, pool.Size(), gravity.theta, directTime);
+    printf("order   rms err     max err     phi err     time (s)\n");
+    gravity.solver = SOLVER_FMM;
+    for (int p = 1; p <= Fmm::MaxOrder; p++)
+    {
+        gravity.order = p;
+        start = chrono::steady_clock::now();
+        gravity.Accelerations(objects);
+        double fmmTime = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        double rms, worst;
+        ForceError(ax, ay, az, rms, worst);
+        double phiWorst = 0;
+        for (int i = 0; i < n; i++)
+            phiWorst = max(phiWorst, phi[i] != 0 ? fabs((gravity.phi[i] - phi[i]) / phi[i]) : 0);
+        printf("%-7d %-11.3e %-11.3e %-11.3e %.4f\n", p, rms, worst, phiWorst, fmmTime);
+    }
+
+    gravity.solver = solver;
+    gravity.order = order;
+    gravity.potential = false;
+}
+
+bool MakeIntegrator(const string &name)
+{
+    integrator.reset(CreateIntegrator(name, tolerance));
+    if (!integrator)
+    {
+        printf("Unknown integrator: %s\n", name.c_str());
+        return false;
+    }
+    BlockHermiteIntegrator *block = dynamic_cast<BlockHermiteIntegrator *>(integrator.get());
+    if (block)
+    {
+        block->eta = eta;
+        if (gravity.solver != SOLVER_DIRECT)
+            printf("The block integrator sums its forces directly, --solver %s is ignored\n", SolverName(gravity.solver));
+    }
+    return true;
+}
+
+//Benchmark scene of n bodies: a heavy center and a thick ring of orbiters, mostly on screen at the default zoom.
+//Every orbiter is drawn from its own benchSeed stream so a size is the same scene on every run and thread count.
+void BenchmarkScene(int n)
+{
+    objects.Clear();
+    objects.Add(10000000000, 0, 0, 0, 0, 0, 0);
+    objects.Reserve(n);
+    for(int i = 1; i < n; i++){
+        Random r = Random::Stream(benchSeed, i);
+        double mass = r.Uniform() * 20000 + 5000;
+        double dist = r.Uniform() * 200 + 50;
+        double angle = r.Uniform() * 2 * M_PI;
+        double height = (r.Uniform() - 0.5) * 10;
+        double v = sqrt(gravity.G * (10000000000 + mass) / dist);
+        objects.Add(mass, dist * cos(angle), dist * sin(angle), height, -v * sin(angle), v * cos(angle), 0);
+    }
+    followObject = -1;
+    stepCount = 0;
+    simTime = 0;
+}
+
+//Times the stages of a step separately for every combination of the --bench-* lists and writes them to benchmarkPath.
+//Merge and gravity are the two halves of Simulate(); publish copies the state into a frame, and convert and draw
+//are the projection and the software rasteriser, as the window and --render-every use them.
+void RunBenchmark()
+{
+    vector<string> sizes = SplitList(benchSizes);
+    vector<string> integrators = SplitList(benchIntegrators);
+    vector<string> threadCounts = SplitList(benchThreads);
+    if (threadCounts.empty())
+    {
+        threadCounts.push_back("1");
+        if (thread::hardware_concurrency() > 1)
+            threadCounts.push_back(to_string(thread::hardware_concurrency()));
+    }
+    timeStep = pow(2, rate);
+    zoom = pow(2, mag);
+    raster.Resize(screenWidth, screenHeight);
+    GravitySolver solver = gravity.solver;
+
+    BenchmarkReport report;
+    report.isa = IsaName(gravity.isa);
+    report.seed = benchSeed;
+    printf("  bodies integrator solver  threads, median per stage\n");
+    for (const string &size : sizes)
+    {
+        int n = max(atoi(size.c_str()), 1);
+        for (const string &count : threadCounts)
+        {
+            pool.Resize(atoi(count.c_str()));
+            for (const string &name : integrators)
+            {
+                gravity.solver = solver == SOLVER_DIRECT && n > benchDirectLimit ? SOLVER_BARNES_HUT : solver;
+                if (!MakeIntegrator(name))
+                    return;
+                BenchmarkScene(n);
+                BenchmarkCase c;
+                c.bodies = n;
+                c.integrator = integrator->Name();
+                bool block = dynamic_cast<BlockHermiteIntegrator *>(integrator.get()) != nullptr;
+                c.solver = SolverName(block ? SOLVER_DIRECT : gravity.solver);
+                c.threads = pool.Size();
+
+                //One untimed step settles the first merges and the integrator's cached forces
+                Simulate();
+                double spent = 0;
+                for (int k = 0; k < benchRepeats && (k == 0 || spent < benchBudget); k++)
+                {
+                    auto t0 = chrono::steady_clock::now();
+                    if (collisions.Merge(objects, mpp, followObject) > 0)
+                        integrator->Reset();
+                    auto t1 = chrono::steady_clock::now();
+                    integrator->Step(objects, gravity, timeStep);
+                    auto t2 = chrono::steady_clock::now();
+                    PublishFrame(offscreenFrame);
+                    frame = &offscreenFrame;
+                    auto t3 = chrono::steady_clock::now();
+                    Convert();
+                    auto t4 = chrono::steady_clock::now();
+                    Rasterize();
+                    auto t5 = chrono::steady_clock::now();
+                    stepCount++;
+                    simTime += timeStep;
+
+                    c.Stage("merge").seconds.push_back(chrono::duration<double>(t1 - t0).count());
+                    c.Stage("gravity").seconds.push_back(chrono::duration<double>(t2 - t1).count());
+                    c.Stage("publish").seconds.push_back(chrono::duration<double>(t3 - t2).count());
+                    c.Stage("convert").seconds.push_back(chrono::duration<double>(t4 - t3).count());
+                    c.Stage("draw").seconds.push_back(chrono::duration<double>(t5 - t4).count());
+                    spent += chrono::duration<double>(t5 - t0).count();
+                }
+                report.Print(c);
+                report.cases.push_back(c);
+            }
+        }
+    }
+    gravity.solver = solver;
+    if (report.Write(benchmarkPath))
+        printf("%zu cases written to %s\n", report.cases.size(), benchmarkPath.c_str());
+}
+
+//Steps the Setup() scene without SDL, writing snapshots, until the step or time limit is reached
+void RunHeadless()
+{
+    if (maxSteps < 0 && untilTime < 0)
+        maxSteps = 1000;
+    if (!LoadScene())
+        return;
+    timeStep = pow(2, rate);
+    printf("headless: %zu bodies, time step %g, solver %s, force law %s, integrator %s\n", objects.size(), timeStep, SolverName(gravity.solver),
+           ForceLawName(gravity.law.kind), integrator->Name());
+    if (renderEvery > 0 && !StartOffscreen())
+        return;
+
+    double simSeconds = 0;
+    auto last = chrono::steady_clock::now();
+    while ((maxSteps < 0 || stepCount < maxSteps) && (untilTime < 0 || simTime < untilTime))
+    {
+        Simulate();
+        RecordTrajectory();
+        bool snapshot = snapshotEvery > 0 && stepCount % snapshotEvery == 0;
+        bool checkpoint = checkpointEvery > 0 && stepCount % checkpointEvery == 0;
+        bool render = renderEvery > 0 && stepCount % renderEvery == 0;
+        if (snapshot || checkpoint || render)
+        {
+            auto now = chrono::steady_clock::now();
+            simSeconds += chrono::duration<double>(now - last).count();
+            if (snapshot)
+                WriteSnapshot();
+            if (checkpoint)
+                Checkpoint();
+            if (render)
+                RenderOffscreen();
+            last = chrono::steady_clock::now();
+        }
+    }
+    simSeconds += chrono::duration<double>(chrono::steady_clock::now() - last).count();
+    WriteSnapshot();
+    if (renderEvery > 0)
+    {
+        encoder.Finish();
+        printf("%ld frames written to %s_*.%s\n", encoder.Encoded(), renderPrefix.c_str(), FrameExtension(encoder.format));
+    }
+
+    printf("%ld steps, simulated time %g, %zu bodies left, %.3f s (%.1f steps/s)\n",
+           stepCount, simTime, objects.size(), simSeconds, simSeconds > 0 ? stepCount / simSeconds : 0);
+    if (diagnostics.IsOpen())
+        printf("%ld diagnostics samples, largest drift: energy %.3e, momentum %.3e, angular momentum %.3e\n", diagnostics.Samples(),
+               diagnostics.EnergyDrift(), diagnostics.MomentumDrift(), diagnostics.AngularDrift());
+}
+
+SnapshotInfo CurrentInfo()
+{
+    SnapshotInfo info;
+    info.step = stepCount;
+    info.time = simTime;
+    info.rate = rate;
+    info.rngState = rng.state;
+    return info;
+}
+
+void WriteSnapshot()
+{
+    if (snapshotFormat == "bin")
+        WriteSnapshotBinary(SnapshotPath(outputPrefix, stepCount, "bin"), objects, CurrentInfo());
+    else
+        WriteSnapshotCsv(SnapshotPath(outputPrefix, stepCount, "csv"), objects, stepCount, simTime);
+}
+
+void Checkpoint()
+{
+    WriteSnapshotBinary(checkpointPath, objects, CurrentInfo());
+}
+
+bool StartOffscreen()
+{
+    if (!cameraScriptPath.empty() && !cameraScript.Load(cameraScriptPath))
+        return false;
+    zoom = pow(2, mag);
+    raster.Resize(screenWidth, screenHeight);
+    encoder.Start(encoders, 4);
+    RenderOffscreen();
+    return true;
+}
+
+//Draws the current state the way the window would and hands the image to the encoder pool
+void RenderOffscreen()
+{
+    if (!cameraScript.Empty())
+    {
+        CameraKey key = cameraScript.At(stepCount);
+        posx = key.posx;
+        posy = key.posy;
+        zoom = key.zoom;
+        camera.SetEuler(key.xang, key.yang, key.zang);
+    }
+    PublishFrame(offscreenFrame);
+    frame = &offscreenFrame;
+    Convert();
+    Rasterize();
+    encoder.Submit(SnapshotPath(renderPrefix, stepCount, FrameExtension(encoder.format)), raster.pixels.data(), raster.width, raster.height);
+}
+
+bool OpenTrajectory()
+{
+    return trajectoryPath.empty() || trajectory.Open(trajectoryPath);
+}
+
+//Hands the current state to the trajectory writer thread; the integrator only pays for the copy
+void RecordTrajectory()
+{
+    if (trajectory.IsOpen() && stepCount % trajectoryEvery == 0)
+        trajectory.Submit(objects, stepCount, simTime);
+}
+
+//Decodes a trajectory file end to end and prints a summary of what it holds
+void TrajectoryInfo()
+{
+    TrajectoryReader reader;
+    if (!reader.Open(trajectoryInfoPath))
+        return;
+    TrajectoryFrame frame;
+    long frames = 0;
+    long firstStep = 0;
+    double firstTime = 0;
+    size_t bodies = 0;
+    while (reader.Next(frame))
+    {
+        if (frames == 0)
+        {
+            firstStep = frame.step;
+            firstTime = frame.time;
+        }
+        frames++;
+        bodies += frame.count;
+    }
+    if (frames == 0)
+    {
+        printf("%s: no frames\n", trajectoryInfoPath.c_str());
+        return;
+    }
+    printf("%s: %ld frames, steps %ld to %ld, time %g to %g, %.1f bodies per frame\n", trajectoryInfoPath.c_str(), frames,
+           firstStep, frame.step, firstTime, frame.time, (double)bodies / frames);
+}
+
+//Restores the --restore snapshot if one was given, otherwise builds the default scene
+bool LoadScene()
+{
+    if (restorePath.empty())
+    {
+        if (scenario.Loaded())
+            return scenario.Build(objects, gravity.G, rng, &pool);
+        Setup();
+        return true;
+    }
+    SnapshotInfo info;
+    if (!LoadSnapshot(restorePath, objects, info))
+        return false;
+    stepCount = info.step;
+    simTime = info.time;
+    rate = info.rate;
+    rng.state = info.rngState;
+    printf("Restored %zu bodies at step %ld from %s\n", objects.size(), stepCount, restorePath.c_str());
+    return true;
+}
+
 void CleanUp()
 {
     //Free up resources
+    sim.Stop();
+    trajectory.Close();
+#ifdef ORBIT_PROFILE
+    if (!tracePath.empty())
+        profiler.WriteTrace(tracePath);
+    overlay.Close();
+#endif
+    glRenderer.Shutdown();
+    if (screenTexture != nullptr)
+        SDL_DestroyTexture(screenTexture);
     SDL_GL_DeleteContext(glContext);
     SDL_DestroyWindow(window);
     SDL_Quit();
@@ -127,38 +988,69 @@ void CleanUp()
 void Run()
 {
     bool gameLoop = true;
-    srand(time(NULL));
 
-    Rots();
-    Setup();
+    if (!LoadScene())
+        return;
+    timeStep = pow(2, rate);
+    sim.stepsPerSecond = simRate;
+    sim.stepsPerFrame = stepsPerFrame;
+    sim.Start(SimStep, PublishFrame);
+    PROFILE_THREAD("render");
     while (gameLoop)
     {   
+        PROFILE_SCOPE("frame");
         zoom = pow(2, mag);
-        timeStep = pow(2, rate);
-        if(followObject == -1){
-            trail.clear();
-            tps.clear();
-        }
-        if(run)
-            Simulate();
-        projection.clear();
-        projection.push_back({xper, 0, 0});
-        projection.push_back({0, yper, 0});
-        Convert();
-        if(followObject != -1){
-            posx = -1 * pps[followObject][0];
-            posy = -1 * pps[followObject][1];
-        }
-        Draw();
-        
-        SDL_RenderPresent(renderer);
-        pos.x = 0;
-        pos.y = 0;
-        pos.w = screenWidth;
-        pos.h = screenHeight;
-        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-        SDL_RenderFillRect(renderer, &pos);
+        sim.FrameTick();
+        sim.Acquire();
+        frame = &sim.Front();
+        {
+            PROFILE_SCOPE("convert");
+            Convert();
+        }
+        if (backend == RENDER_GL)
+        {
+            {
+                PROFILE_SCOPE("draw");
+                glRenderer.Draw(screenWidth, screenHeight, pps, frame->mass.data(), zoom / mpp, visible, tps, frame->trailStarts, viewFollow);
+            }
+            PROFILE_SCOPE("present");
+            SDL_GL_SwapWindow(window);
+        }
+        else if (backend == RENDER_SOFT)
+        {
+            {
+                PROFILE_SCOPE("draw");
+                Rasterize();
+            }
+            PROFILE_SCOPE("present");
+            SDL_UpdateTexture(screenTexture, NULL, raster.pixels.data(), raster.width * sizeof(uint32_t));
+            SDL_RenderCopy(renderer, screenTexture, NULL, NULL);
+#ifdef ORBIT_PROFILE
+            overlay.Draw(renderer, profiler);
+#endif
+            SDL_RenderPresent(renderer);
+        }
+        else
+        {
+            {
+                PROFILE_SCOPE("draw");
+                Draw();
+            }
+
+            PROFILE_SCOPE("present");
+#ifdef ORBIT_PROFILE
+            overlay.Draw(renderer, profiler);
+#endif
+            SDL_RenderPresent(renderer);
+            pos.x = 0;
+            pos.y = 0;
+            pos.w = screenWidth;
+            pos.h = screenHeight;
+            SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+            SDL_RenderFillRect(renderer, &pos);
+        }
     
+        PROFILE_SCOPE("events");
         SDL_Event event;
         while (SDL_PollEvent(&event))
         {
@@ -174,7 +1066,7 @@ void Run()
                         gameLoop = false;
                         break;
                     case SDLK_SPACE:
-                        run = !run;
+                        sim.SetRunning(!sim.Running());
                         break;
                     case SDLK_r:
                         mag++;
@@ -184,62 +1076,67 @@ void Run()
                         break;
                     case SDLK_w:
                         posy += (screenHeight / 20) / zoom;
-                        followObject = -1;
+                        followReleased = true;
+                        sim.Post([]{ followObject = -1; });
                         break;
                     case SDLK_s:
                         posy -= (screenHeight / 20) / zoom;
-                        followObject = -1;
+                        followReleased = true;
+                        sim.Post([]{ followObject = -1; });
                         break;
                     case SDLK_a:
                         posx += (screenWidth / 20) / zoom;
-                        followObject = -1;
+                        followReleased = true;
+                        sim.Post([]{ followObject = -1; });
                         break;
                     case SDLK_d:
                         posx -= (screenWidth / 20) / zoom;
-                        followObject = -1;
+                        followReleased = true;
+                        sim.Post([]{ followObject = -1; });
                         break;
                     case SDLK_q:
-                        rate--;
-                        trail.clear();
+                        sim.Post([]{ rate--; trails.ClearPoints(); });
                         break;
                     case SDLK_e:
-                        rate++;
-                        trail.clear();
+                        sim.Post([]{ rate++; trails.ClearPoints(); });
                         break;
                     case SDLK_c:
-                        followObject = -1;
+                        followReleased = true;
+                        sim.Post([]{ followObject = -1; });
                         break;
                     case SDLK_x:
-                        followObject++;
-                        if(followObject > objects.size() - 1)
-                            followObject = 0;
-                        trail.clear();
+                        followReleased = false;
+                        sim.Post([]{
+                            followObject++;
+                            if(followObject > objects.size() - 1)
+                                followObject = 0;
+                        });
                         break;
                     case SDLK_z:
-                        followObject--;
-                        if(followObject < 0)
-                            followObject = objects.size() - 1;
-                        trail.clear();
+                        followReleased = false;
+                        sim.Post([]{
+                            followObject--;
+                            if(followObject < 0)
+                                followObject = objects.size() - 1;
+                        });
                         break;
                     case SDLK_UP:
-                        xang += .01;
-                        if(xang > 2*M_PI)
-                            xang -= 2 * M_PI;
+                        camera.RotateLocal(1, 0, 0, .01);
                         break;
                     case SDLK_DOWN:
-                        xang -= .01;
-                        if(xang < 0)
-                            xang += 2 * M_PI;
+                        camera.RotateLocal(1, 0, 0, -.01);
                         break;
                     case SDLK_RIGHT:
-                        yang += .01;
-                        if(yang > 2*M_PI)
-                            yang -= 2 * M_PI;
+                        camera.RotateWorld(0, 1, 0, .01);
                         break;
                     case SDLK_LEFT:
-                        yang -= .01;
-                        if(yang < 0)
-                            yang += 2 * M_PI;
+                        camera.RotateWorld(0, 1, 0, -.01);
+                        break;
+                    case SDLK_PAGEUP:
+                        camera.RotateLocal(0, 0, 1, .01);
+                        break;
+                    case SDLK_PAGEDOWN:
+                        camera.RotateLocal(0, 0, 1, -.01);
                         break;
                     case SDLK_t:
                         xper += .01;
@@ -259,6 +1156,14 @@ void Run()
                     case SDLK_j:
                         zper -= .01;
                         break;
+#ifdef ORBIT_PROFILE
+                    case SDLK_F1:
+                        overlay.visible = !overlay.visible;
+                        break;
+                    case SDLK_F2:
+                        profiler.WriteTrace(tracePath.empty() ? "trace.json" : tracePath);
+                        break;
+#endif
                     default:
                         break;
                 }
@@ -276,129 +1181,172 @@ void Run()
     }
 }
 
+//Keeps a trail on the followed body covering the last 10000 time units, or maxFollowTrail points at small steps,
+//replacing the previous one
+void FollowTrail(){
+    uint64_t id = followObject >= 0 && followObject < objects.size() ? objects.id[followObject] : UINT64_MAX;
+    if(id != followTrail){
+        if(followTrail != UINT64_MAX)
+            trails.Untrack(followTrail);
+        followTrail = UINT64_MAX;
+        //Bodies given with --trail keep their own settings and outlive the follow
+        if(id == UINT64_MAX || trails.Tracked(id))
+            return;
+    }
+    //Tracking again picks up a changed time step, which clears the trail like before
+    size_t capacity = static_cast<size_t>(max(min(10000 / timeStep / trailDecimation, static_cast<double>(maxFollowTrail)), 1.0));
+    trails.Track(id, capacity, trailDecimation);
+    followTrail = id;
+}
+
+//One simulation step on the simulation thread
+void SimStep(){
+    PROFILE_THREAD("simulation");
+    PROFILE_SCOPE("step");
+    timeStep = pow(2, rate);
+    FollowTrail();
+    Simulate();
+    RecordTrajectory();
+    if(checkpointEvery > 0 && stepCount % checkpointEvery == 0)
+        Checkpoint();
+}
+
+void PublishFrame(SimFrame &frame){
+    PROFILE_SCOPE("publish");
+    frame.mass.assign(objects.mass.begin(), objects.mass.end());
+    frame.x.assign(objects.x.begin(), objects.x.end());
+    frame.y.assign(objects.y.begin(), objects.y.end());
+    frame.z.assign(objects.z.begin(), objects.z.end());
+    frame.id.assign(objects.id.begin(), objects.id.end());
+    trails.Pack(frame.trail, frame.trailStarts);
+    frame.follow = followObject;
+    frame.step = stepCount;
+    frame.time = simTime;
+}
+
 void Setup(){
-    objects.push_back({10000, -177, 0, 0, 0, -.03252, 0}); //mass x y z vx vy vz
-    objects.push_back({10000, -176, 0, 0, 0, -.02072, 0});
-    objects.push_back({25000000, -175, 0, 0, 0, -.06183, 0});
-    objects.push_back({100, -75.25, 0, 0, 0, -.09253, 0});
-    objects.push_back({10000, -75, 0, 0, 0, -.09433, 0});
-    objects.push_back({10000, 0, 0, -75, 0, -.09433, 0});
-    objects.push_back({10000, -50, 0, 0, 0, -.11553, 0});
-    objects.push_back({10000, -25, 0, 0, 0, -.16339, 0});
-    objects.push_back({10000000000, 0, 0, 0, 0, 0, 0});
+    objects.Add(10000, -177, 0, 0, 0, -.03252, 0); //mass x y z vx vy vz
+    objects.Add(10000, -176, 0, 0, 0, -.02072, 0);
+    objects.Add(25000000, -175, 0, 0, 0, -.06183, 0);
+    objects.Add(100, -75.25, 0, 0, 0, -.09253, 0);
+    objects.Add(10000, -75, 0, 0, 0, -.09433, 0);
+    objects.Add(10000, 0, 0, -75, 0, -.09433, 0);
+    objects.Add(10000, -50, 0, 0, 0, -.11553, 0);
+    objects.Add(10000, -25, 0, 0, 0, -.16339, 0);
+    objects.Add(10000000000, 0, 0, 0, 0, 0, 0);
     
-    for(int i = 0; i < 20; i++){
-        double mass = static_cast<double>(rand()) / RAND_MAX * 20000 + 5000;
-        double dist = static_cast<double>(rand()) / RAND_MAX * 100 - 375;
-        double v = sqrt(((6.674 / pow(10, 11)) * (10000000000 + mass)) / abs(dist));
-        objects.push_back({mass, dist, 0, 0, 0, -1 * (v * (1.05 - (.1 * static_cast<double>(rand())/RAND_MAX))), 0});
+    for(int i = 0; i < ringBodies; i++){
+        double mass = rng.Uniform() * 20000 + 5000;
+        double dist = rng.Uniform() * 100 - 375;
+        double v = sqrt((gravity.G * (10000000000 + mass)) / abs(dist));
+        objects.Add(mass, dist, 0, 0, 0, -1 * (v * (1.05 - (.1 * rng.Uniform()))), 0);
     }
-    for(int i = 0; i < 20; i++){
-        double mass = static_cast<double>(rand()) / RAND_MAX * 20000 + 5000;
-        double dist = static_cast<double>(rand()) / RAND_MAX * 100 + 275;
-        double v = sqrt(((6.674 / pow(10, 11)) * (10000000000 + mass)) / abs(dist));
-        objects.push_back({mass, dist, 0, 0, 0, v * (1.05 - (.1 * static_cast<double>(rand())/RAND_MAX)), 0});
+    for(int i = 0; i < ringBodies; i++){
+        double mass = rng.Uniform() * 20000 + 5000;
+        double dist = rng.Uniform() * 100 + 275;
+        double v = sqrt((gravity.G * (10000000000 + mass)) / abs(dist));
+        objects.Add(mass, dist, 0, 0, 0, v * (1.05 - (.1 * rng.Uniform())), 0);
     }
-    for(int i = 0; i < 20; i++){
-        double mass = static_cast<double>(rand()) / RAND_MAX * 20000 + 5000;
-        double dist = static_cast<double>(rand()) / RAND_MAX * 100 - 375;
-        double v = sqrt(((6.674 / pow(10, 11)) * (10000000000 + mass)) / abs(dist));
-        objects.push_back({mass, 0, dist, 0, v * (1.05 - (.1 * static_cast<double>(rand())/RAND_MAX)), 0, 0});
+    for(int i = 0; i < ringBodies; i++){
+        double mass = rng.Uniform() * 20000 + 5000;
+        double dist = rng.Uniform() * 100 - 375;
+        double v = sqrt((gravity.G * (10000000000 + mass)) / abs(dist));
+        objects.Add(mass, 0, dist, 0, v * (1.05 - (.1 * rng.Uniform())), 0, 0);
     }
-    for(int i = 0; i < 20; i++){
-        double mass = static_cast<double>(rand()) / RAND_MAX * 20000 + 5000;
-        double dist = static_cast<double>(rand()) / RAND_MAX * 100 + 275;
-        double v = sqrt(((6.674 / pow(10, 11)) * (10000000000 + mass)) / abs(dist));
-        objects.push_back({mass, 0, dist, 0, -1 * v * (1.05 - (.1 * static_cast<double>(rand())/RAND_MAX)), 0, 0});
+    for(int i = 0; i < ringBodies; i++){
+        double mass = rng.Uniform() * 20000 + 5000;
+        double dist = rng.Uniform() * 100 + 275;
+        double v = sqrt((gravity.G * (10000000000 + mass)) / abs(dist));
+        objects.Add(mass, 0, dist, 0, -1 * v * (1.05 - (.1 * rng.Uniform())), 0, 0);
     }
 }
 
+//Builds one combined transform for the frame and projects every body and trail point through it
 void Convert(){
-    pps.clear();
-    tps.clear();
-    vector<vector<double>> xyz;
-    vector<double> temp;
-    temp.clear();
-    Rots();
-    for(int i = 0; i < objects.size(); i++){
-        xyz.clear();
-        temp.clear();
-        for(int j = 1; j < 4; j++){
-            temp.push_back(objects[i][j]);
-            xyz.push_back(temp);
-            temp.clear();
-        }
-        vector<vector<double>> rotated = MultMatrixs(roty, xyz);
-        rotated = MultMatrixs(rotx, rotated);
-        rotated = MultMatrixs(rotz, rotated);
-        vector<vector<double>> xys = MultMatrixs(projection, rotated);
-        for(int j = 0; j < xys.size(); j++){
-            temp.push_back(xys[j][0]);
-        }
-        pps.push_back(temp);
-    }
-    for(int i = 0; i < trail.size(); i++){
-        xyz.clear();
-        temp.clear();
-        for(int j = 0; j < 3; j++){
-            temp.push_back(trail[i][j]);
-            xyz.push_back(temp);
-            temp.clear();
-        }
-        vector<vector<double>> rotated = MultMatrixs(roty, xyz);
-        rotated = MultMatrixs(rotx, rotated);
-        rotated = MultMatrixs(rotz, rotated);
-        vector<vector<double>> xys = MultMatrixs(projection, rotated);
-        for(int j = 0; j < xys.size(); j++){
-            temp.push_back(xys[j][0]);
-        }
-        tps.push_back(temp);
+    camera.SetScale(xper, yper);
+    const Matrix4 &view = camera.View();
+    //A pan releases the follow at once, so the frames still published with it do not snap the view back
+    if(followReleased && frame->follow == -1)
+        followReleased = false;
+    viewFollow = followReleased ? -1 : frame->follow;
+    if(viewFollow != -1){
+        int f = viewFollow;
+        posx = -1 * view.X(frame->x[f], frame->y[f], frame->z[f]);
+        posy = -1 * view.Y(frame->x[f], frame->y[f], frame->z[f]);
     }
+    const Matrix4 &screen = camera.Screen(posx, posy, zoom, screenWidth, screenHeight);
+    ProjectPoints(gravity.isa, screen, frame->x.data(), frame->y.data(), frame->z.data(), frame->x.size(), pps);
+    ProjectPacked(screen, frame->trail.data(), frame->trail.size() / 3, tps);
+    Cull();
 }
 
-void Draw(){
+//Keeps the bodies whose square touches the screen and splits off the ones too small to draw as discs.
+//With the orthographic view the frustum test is the same two dot products as the projection, so it runs
+//on the projected positions before any per-body drawing work.
+void Cull(){
+    visible.clear();
+    splats.clear();
+    double pixelsPerMass = zoom / mpp;
     for(int i = 0; i < pps.size(); i++){
-        if(followObject == i){
-            int x = static_cast<int>((pps[i][0] + posx)*zoom + screenWidth/2 - (ceil(objects[i][0] / mpp * zoom) + 1)/2) - ceil(((ceil(objects[i][0] / mpp * zoom) + 1)/2) * 1.25) - 1;
-            int y = static_cast<int>((pps[i][1] + posy)*zoom + screenHeight/2 - (ceil(objects[i][0] / mpp * zoom) + 1)/2) - ceil(((ceil(objects[i][0] / mpp * zoom) + 1)/2) * 1.25) - 1;
+        double size = ceil(frame->mass[i] * pixelsPerMass) + 1;
+        double reach = size / 2;
+        if(i == viewFollow)
+            reach += ceil(size / 2 * 1.25) + 1; //Keep the follow box
+        if(pps.x[i] + reach < 0 || pps.x[i] - reach >= screenWidth || pps.y[i] + reach < 0 || pps.y[i] - reach >= screenHeight)
+            continue;
+        if(size <= lodPixels && i != viewFollow)
+            splats.push_back(i);
+        else
+            visible.push_back(i);
+    }
+    splatStart = visible.size();
+    visible.insert(visible.end(), splats.begin(), splats.end());
+}
+
+void Draw(){
+    for(int k = 0; k < visible.size(); k++){
+        int i = visible[k];
+        if(viewFollow == i){
+            int x = static_cast<int>(pps.x[i] - (ceil(frame->mass[i] / mpp * zoom) + 1)/2) - ceil(((ceil(frame->mass[i] / mpp * zoom) + 1)/2) * 1.25) - 1;
+            int y = static_cast<int>(pps.y[i] - (ceil(frame->mass[i] / mpp * zoom) + 1)/2) - ceil(((ceil(frame->mass[i] / mpp * zoom) + 1)/2) * 1.25) - 1;
             pos.x = x;
             pos.y = y;
-            pos.w = ceil(objects[i][0] / mpp * zoom) + 1 + 2 * round(static_cast<int>((pps[i][0] + posx)*zoom + screenWidth/2 - (ceil(objects[i][0] / mpp * zoom) + 1)/2) - x);
+            pos.w = ceil(frame->mass[i] / mpp * zoom) + 1 + 2 * round(static_cast<int>(pps.x[i] - (ceil(frame->mass[i] / mpp * zoom) + 1)/2) - x);
             pos.h = 1;
             SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
             SDL_RenderFillRect(renderer, &pos);
             
-            pos.x = x + ceil(objects[i][0] / mpp * zoom) + 1 + 2 * round(static_cast<int>((pps[i][0] + posx)*zoom + screenWidth/2 - (ceil(objects[i][0] / mpp * zoom) + 1)/2) - x) - 1;
+            pos.x = x + ceil(frame->mass[i] / mpp * zoom) + 1 + 2 * round(static_cast<int>(pps.x[i] - (ceil(frame->mass[i] / mpp * zoom) + 1)/2) - x) - 1;
             pos.y = y;
             pos.w = 1;
-            pos.h = ceil(objects[i][0] / mpp * zoom) + 1 + 2 * round(static_cast<int>((pps[i][1] + posy)*zoom + screenHeight/2 - (ceil(objects[i][0] / mpp * zoom) + 1)/2) - y);
+            pos.h = ceil(frame->mass[i] / mpp * zoom) + 1 + 2 * round(static_cast<int>(pps.y[i] - (ceil(frame->mass[i] / mpp * zoom) + 1)/2) - y);
             SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
             SDL_RenderFillRect(renderer, &pos);
 
             pos.x = x;
             pos.y = y;
             pos.w = 1;
-            pos.h = ceil(objects[i][0] / mpp * zoom) + 1 + 2 * round(static_cast<int>((pps[i][1] + posy)*zoom + screenHeight/2 - (ceil(objects[i][0] / mpp * zoom) + 1)/2) - y);
+            pos.h = ceil(frame->mass[i] / mpp * zoom) + 1 + 2 * round(static_cast<int>(pps.y[i] - (ceil(frame->mass[i] / mpp * zoom) + 1)/2) - y);
             SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
             SDL_RenderFillRect(renderer, &pos);
 
             pos.x = x;
-            pos.y = y + ceil(objects[i][0] / mpp * zoom) + 1 + 2 * round(static_cast<int>((pps[i][1] + posy)*zoom + screenHeight/2 - (ceil(objects[i][0] / mpp * zoom) + 1)/2) - y) - 1;
-            pos.w = ceil(objects[i][0] / mpp * zoom) + 1 + 2 * round(static_cast<int>((pps[i][0] + posx)*zoom + screenWidth/2 - (ceil(objects[i][0] / mpp * zoom) + 1)/2) - x);
+            pos.y = y + ceil(frame->mass[i] / mpp * zoom) + 1 + 2 * round(static_cast<int>(pps.y[i] - (ceil(frame->mass[i] / mpp * zoom) + 1)/2) - y) - 1;
+            pos.w = ceil(frame->mass[i] / mpp * zoom) + 1 + 2 * round(static_cast<int>(pps.x[i] - (ceil(frame->mass[i] / mpp * zoom) + 1)/2) - x);
             pos.h = 1;
             SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
             SDL_RenderFillRect(renderer, &pos);
         }
-        SDL_Point center = {static_cast<int>(round((pps[i][0] + posx)*zoom + screenWidth/2)), static_cast<int>(round((pps[i][1] + posy)*zoom + screenHeight/2))};
-        int radius = static_cast<int>(round((ceil(objects[i][0] / mpp * zoom) + 1)/2));
+        SDL_Point center = {static_cast<int>(round(pps.x[i])), static_cast<int>(round(pps.y[i]))};
+        int radius = static_cast<int>(round((ceil(frame->mass[i] / mpp * zoom) + 1)/2));
         SDL_Color color = {255, 255, 255, 255};
         if(center.x >= 0-radius && center.x < screenWidth+radius && center.y >= 0-radius && center.y < screenHeight+radius && radius > 4)
             DrawCircle(center, radius, color);
         else{
-            pos.x = static_cast<int>((pps[i][0] + posx)*zoom + screenWidth/2 - (ceil(objects[i][0] / mpp * zoom) + 1)/2);
-            pos.y = static_cast<int>((pps[i][1] + posy)*zoom + screenHeight/2 - (ceil(objects[i][0] / mpp * zoom) + 1)/2);
-            pos.w = ceil(objects[i][0] / mpp * zoom) + 1;
-            pos.h = ceil(objects[i][0] / mpp * zoom) + 1;
+            pos.x = static_cast<int>(pps.x[i] - (ceil(frame->mass[i] / mpp * zoom) + 1)/2);
+            pos.y = static_cast<int>(pps.y[i] - (ceil(frame->mass[i] / mpp * zoom) + 1)/2);
+            pos.w = ceil(frame->mass[i] / mpp * zoom) + 1;
+            pos.h = ceil(frame->mass[i] / mpp * zoom) + 1;
             SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
             SDL_RenderFillRect(renderer, &pos);
         }
@@ -407,8 +1355,8 @@ void Draw(){
     px = 0;
     py = 0;
     for(int i = 0; i < tps.size(); i++){
-        x = static_cast<int>((tps[i][0] + posx)*zoom + screenWidth/2);
-        y = static_cast<int>((tps[i][1] + posy)*zoom + screenHeight/2);
+        x = static_cast<int>(tps.x[i]);
+        y = static_cast<int>(tps.y[i]);
         if(!(x == px && y == py) || x > screenWidth || x < 0 || y > screenHeight || y < 0){
             pos.x = x;
             pos.y = y;
@@ -420,144 +1368,55 @@ void Draw(){
     }
 }
 
-void Simulate(){
-    for(int i = 0; i < objects.size(); i++){
-        for(int j = 0; j < objects.size(); j++){
-            if(i != j){
-                if(sqrt(pow(objects[j][1] - objects[i][1], 2) + pow(objects[j][2] - objects[i][2], 2) + pow(objects[j][3] - objects[i][3], 2)) < (objects[i][0] / mpp)/2 + (objects[j][0] / mpp)/2){
-                    double vx = (objects[i][0] * objects[i][4] + objects[j][0] * objects[j][4]) / (objects[i][0] + objects[j][0]);
-                    double vy = (objects[i][0] * objects[i][5] + objects[j][0] * objects[j][5]) / (objects[i][0] + objects[j][0]);
-                    double vz = (objects[i][0] * objects[i][6] + objects[j][0] * objects[j][6]) / (objects[i][0] + objects[j][0]);
-                    objects[i][0] += objects[j][0];
-                    objects[i][4] = vx;
-                    objects[i][5] = vy;
-                    objects[i][6] = vz;
-                    objects.erase(objects.begin()+j);
-                    if(j < i){
-                        i--;
-                        j--;
-                    }
-                    else
-                        j--;
-                }
-            }
-        }
+//Draws the frame into the software framebuffer: trails as anti-aliased polylines, then the bodies
+void Rasterize(){
+    raster.Clear();
+    for(int k = 0; k + 1 < frame->trailStarts.size(); k++){
+        int start = frame->trailStarts[k];
+        raster.Polyline(tps.x.data() + start, tps.y.data() + start, frame->trailStarts[k + 1] - start);
     }
-    for(int i = 0; i < objects.size(); i++){
-        int trailLength = 10000 / timeStep;
-        if(i == followObject){
-            if(trail.size() == trailLength){
-                for(int k = 0; k < trail.size()-1; k++){
-                        trail[k] = trail[k+1];
-                }
-                trail[trail.size()-1] = {objects[i][1], objects[i][2], objects[i][3]};
-            }
-            else
-                trail.push_back({objects[i][1], objects[i][2], objects[i][3]});
-        }
-        for(int j = 0; j < objects.size(); j++){
-            if(i != j){
-                double Fg = ((6.674 / pow(10, 11)) * objects[i][0] * objects[j][0]) / pow(sqrt(pow(objects[j][1] - objects[i][1], 2) + pow(objects[j][2] - objects[i][2], 2) + pow(objects[j][3] - objects[i][3], 2)), 2) * timeStep;
-
-                double x = objects[j][1] - objects[i][1];
-                double y = objects[j][2] - objects[i][2];
-                double z = objects[j][3] - objects[i][3];
-                double ang = atan2(z, sqrt(pow(x, 2) + pow(y, 2)));
-                if(ang < 0)
-                    ang += 2*M_PI;
-                double vz = Fg * sin(ang);
-                double vxy = Fg * cos(ang);
-                ang = atan2(y, x);
-                if(ang < 0)
-                    ang += 2*M_PI;
-                double vx = vxy * cos(ang);
-                double vy = vxy * sin(ang);
-                objects[i][4] += vx / objects[i][0];
-                objects[i][5] += vy / objects[i][0];
-                objects[i][6] += vz / objects[i][0];
-            }
-        }
+    for(int k = splatStart; k < visible.size(); k++){
+        int i = visible[k];
+        double size = ceil(frame->mass[i] / mpp * zoom) + 1;
+        raster.Splat(pps.x[i], pps.y[i], size * size);
     }
-    
-    for(int i = 0; i < objects.size(); i++){
-        objects[i][1] += objects[i][4] * timeStep;
-        objects[i][2] += objects[i][5] * timeStep;
-        objects[i][3] += objects[i][6] * timeStep;
+    raster.ResolveSplats();
+    for(int k = 0; k < splatStart; k++){
+        int i = visible[k];
+        //Clamped so extreme zoom cannot overflow the integer box coordinates
+        int size = min(ceil(frame->mass[i] / mpp * zoom) + 1, 1e8);
+        int x = static_cast<int>(pps.x[i] - size/2.0);
+        int y = static_cast<int>(pps.y[i] - size/2.0);
+        if(viewFollow == i){
+            int margin = ceil(size/2.0 * 1.25) + 1;
+            raster.Outline(x - margin, y - margin, size + 2 * margin, size + 2 * margin);
+        }
+        double radius = round(size/2.0);
+        if(radius > 4)
+            raster.FillDisc(pps.x[i], pps.y[i], radius);
+        else
+            raster.FillRect(x, y, size, size);
     }
 }
 
-vector<vector<double>> MultMatrixs(vector<vector<double>> mat1, vector<vector<double>> mat2){
-    vector<vector<double>> result;
-    vector<double> temp;
-    double a = 0;
-    for(int j = 0; j < mat1.size(); j++){
-        for(int k = 0; k < mat2[0].size(); k++){
-            for(int i = 0; i < mat1[j].size(); i++){
-                a+= mat1[j][i] * mat2[i][k];
-            }
-            temp.push_back(a);
-            a = 0;
-        }
-        result.push_back(temp);
-        temp.clear();
-    }
-    return result;
-}
-
-void Rots(){
-    vector<double> temp;
-    rotx.clear();
-    roty.clear();
-    rotz.clear();
-
-    temp.clear();
-    temp.push_back(1);
-    temp.push_back(0);
-    temp.push_back(0);
-    rotx.push_back(temp);
-    temp.clear();
-    temp.push_back(0);
-    temp.push_back(cos(xang));
-    temp.push_back(-1*sin(xang));
-    rotx.push_back(temp);
-    temp.clear();
-    temp.push_back(0);
-    temp.push_back(sin(xang));
-    temp.push_back(cos(xang));
-    rotx.push_back(temp);
-    temp.clear();
-
-    temp.push_back(cos(yang));
-    temp.push_back(0);
-    temp.push_back(sin(yang));
-    roty.push_back(temp);
-    temp.clear();
-    temp.push_back(0);
-    temp.push_back(1);
-    temp.push_back(0);
-    roty.push_back(temp);
-    temp.clear();
-    temp.push_back(-1*sin(yang));
-    temp.push_back(0);
-    temp.push_back(cos(yang));
-    roty.push_back(temp);
-    temp.clear();
-
-    temp.push_back(cos(zang));
-    temp.push_back(-1*sin(zang));
-    temp.push_back(0);
-    rotz.push_back(temp);
-    temp.clear();
-    temp.push_back(sin(zang));
-    temp.push_back(cos(zang));
-    temp.push_back(0);
-    rotz.push_back(temp);
-    temp.clear();
-    temp.push_back(0);
-    temp.push_back(0);
-    temp.push_back(1);
-    rotz.push_back(temp);
-    temp.clear();
+void Simulate(){
+    {
+        PROFILE_SCOPE("merge");
+        if(collisions.Merge(objects, mpp, followObject) > 0)
+            integrator->Reset();
+    }
+    {
+        PROFILE_SCOPE("trails");
+        trails.Record(objects);
+    }
+    diagnostics.BeforeStep(objects, gravity, *integrator, stepCount, simTime);
+    {
+        PROFILE_SCOPE("gravity");
+        integrator->Step(objects, gravity, timeStep);
+    }
+    diagnostics.AfterStep(objects, gravity, *integrator, stepCount + 1, simTime + timeStep);
+    stepCount++;
+    simTime += timeStep;
 }
 
 void DrawCircle(SDL_Point center, int radius, SDL_Color color)